@@ -0,0 +1,23 @@
+//Minimal test helpers
+#include <time.h>
+
+int check_failed = 0;
+
+#define CHECK(cond) do { if(!(cond)) { check_failed++; \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); } } while(0)
+
+//Print summary line, returns exit code
+int check_result(const char *name)
+{
+    printf("%s: %s\n", name, check_failed ? "FAILED" : "ok");
+    return check_failed != 0;
+}
+
+//Monotonic time in ns for timings
+double check_ns(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
@@ -0,0 +1,29 @@
+//Firmware built for the host
+//AVR headers come from stub/, peripherals are modelled in hw.h.
+//long is 32 bit and int 16 bit on the AVR: long is mapped to int (32 bit).
+//With -DFW_INT16 the firmware is included from micro26_int16.c instead,
+//a copy with int and long replaced by int16_t and int32_t (see Makefile):
+//values that do not fit into 16 bit variables, parameters and return
+//values wrap like on the AVR. Intermediate results of int16_t operands
+//are still computed in 32 bit (C promotes them to the host's int).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+
+#define main fw_main
+#define strlen fw_strlen
+#ifdef FW_INT16
+#include "micro26_int16.c"
+#else
+#define long int
+#include "../micro26.c"
+#undef long
+#endif
+#undef strlen
+#undef main
+
+#include "hw.h"
@@ -0,0 +1,335 @@
+//Hardware model for host tests
+//TWI master with devices on the bus, timers 0 and 1, ADC triggered by
+//timer 0, pin change interrupt of the encoder and interrupt dispatch.
+//Time is simulated at 16 MHz CPU clock.
+//hw_poll() lets the peripherals act on register writes and runs pending
+//ISRs if the I flag in SREG is set. Tests either call it by hand (single
+//stepping, hw_poll_max() for a given number of events) or let hw_run()
+//call it from a periodic signal, so interrupts hit the main program at
+//random points like on the real MCU.
+
+#include <signal.h>
+#include <sys/time.h>
+
+#if (F_CPU != 16000000UL)
+#error "Model times are for a 16 MHz CPU clock"
+#endif
+
+//Bus timing at 400 kHz in ns
+#define HW_BIT_NS 2500
+#define HW_BYTE_NS (9 * HW_BIT_NS)  //8 bits + ACK
+#define HW_START_NS HW_BIT_NS
+#define HW_STOP_NS HW_BIT_NS
+
+//TWI slave, 'write' returns 1 for ACK and 0 for NACK
+typedef struct
+{
+    uint8_t addr;
+    void (*start)(void);
+    int (*write)(uint8_t);
+    void (*stop)(void);
+} hw_dev;
+
+#define HW_DEVICES 4
+hw_dev *hw_dev_list[HW_DEVICES];
+hw_dev *hw_dev_cur = 0;   //Addressed slave
+
+uint64_t hw_ns = 0;       //Simulated time
+int hw_twint = 0;         //TWINT flag
+int hw_phase = 0;         //0: bus free, 1: after START, 2: after address
+volatile int hw_busy = 0; //hw_poll() running
+
+//ADC inputs by MUX channel, or from a function if set
+uint16_t hw_adc_value[8];
+int (*hw_adc_input)(int channel) = 0;
+int hw_adif = 0;          //Conversion complete
+int hw_ocf0a = 0;         //Timer 0 compare flag, TIFR0 is write one to clear
+uint64_t hw_adc_conversions = 0;
+
+//Port D pins from a function of time if set (encoder), else hw_pins()
+uint8_t (*hw_pind_input)(uint64_t ns) = 0;
+int hw_pcif2 = 0;         //Pin change flag of PCINT23:16
+
+//Simulated time per signal of hw_run()
+uint64_t hw_tick_ns = 0;
+
+//Bus statistics, reset by tests
+unsigned long hw_twi_trans = 0, hw_twi_bytes = 0;
+uint64_t hw_twi_ns = 0;
+
+void hw_attach(hw_dev *d)
+{
+    int t1;
+    
+    for(t1 = 0; t1 < HW_DEVICES; t1++)
+    {
+        if(!hw_dev_list[t1])
+        {
+            hw_dev_list[t1] = d;
+            return;
+        }
+    }
+}
+
+//Set port D pins, a change of a pin enabled in PCMSK2 sets PCIF2
+void hw_pins(uint8_t pind)
+{
+    if((pind ^ PIND) & PCMSK2)
+    {
+        hw_pcif2 = 1;
+    }
+    PIND = pind;
+}
+
+void hw_twi_stats_reset(void)
+{
+    hw_twi_trans = 0;
+    hw_twi_bytes = 0;
+    hw_twi_ns = 0;
+}
+
+//Let time pass
+//Timer 1 counts at 15625 Hz and sets OCF1A at TIMER1_TOP. Timer 0 (CTC,
+//prescaler 64) sets OCF0A at OCR0A, which starts an ADC conversion if
+//auto trigger is on and the flag was clear (the ISR clears it).
+void hw_advance(uint64_t ns)
+{
+    uint64_t t0 = hw_ns / 64000, t1, p0;
+    int ch;
+    
+    p0 = (uint64_t) (OCR0A + 1) * 4000; //64 / 16 MHz = 4 us per count
+    if((TCCR0B & 7) && (hw_ns + ns) / p0 != hw_ns / p0)
+    {
+        if(!hw_ocf0a && (ADCSRA & (1 << ADEN)) && (ADCSRA & (1 << ADATE)))
+        {
+            ch = ADMUX & 0x0F;
+            ADCW = hw_adc_input ? hw_adc_input(ch) : hw_adc_value[ch & 7];
+            hw_adif = 1;
+            hw_adc_conversions++;
+        }
+        hw_ocf0a = 1;
+    }
+    
+    hw_ns += ns;
+    if(hw_pind_input)
+    {
+        hw_pins(hw_pind_input(hw_ns));
+    }
+    if(!(TCCR1B & 7))
+    {
+        return;
+    }
+    t1 = hw_ns / 64000;
+    if(t1 / (TIMER1_TOP + 1) != t0 / (TIMER1_TOP + 1))
+    {
+        TIFR1 |= (1 << OCF1A);
+    }
+    TCNT1 = t1 % (TIMER1_TOP + 1);
+}
+
+static void hw_twi_time(uint64_t ns)
+{
+    hw_twi_ns += ns;
+    hw_advance(ns);
+}
+
+static void hw_twi_stop(void)
+{
+    if(hw_dev_cur && hw_dev_cur->stop)
+    {
+        hw_dev_cur->stop();
+    }
+    hw_dev_cur = 0;
+}
+
+//Carry out the action started by writing TWCR with TWINT set
+static int hw_twi(void)
+{
+    uint8_t c = TWCR, b;
+    int t1, ack;
+    
+    if(!(c & (1 << TWINT)) || !(c & (1 << TWEN)))
+    {
+        return 0;
+    }
+    TWCR = c & ~(1 << TWINT); //Writing one clears the flag
+    hw_twint = 0;
+    
+    if(c & (1 << TWSTO))
+    {
+        if(hw_phase)
+        {
+            hw_twi_stop();
+            hw_twi_time(HW_STOP_NS);
+        }
+        hw_phase = 0;
+        if(!(c & (1 << TWSTA)))
+        {
+            return 1; //No interrupt after STOP
+        }
+    }
+    
+    if(c & (1 << TWSTA))
+    {
+        TWSR = hw_phase ? TW_REP_START : TW_START;
+        if(hw_phase)
+        {
+            hw_twi_stop();
+        }
+        hw_phase = 1;
+        hw_twi_time(HW_START_NS);
+    }
+    else
+    {
+        b = TWDR;
+        hw_twi_bytes++;
+        hw_twi_time(HW_BYTE_NS);
+        if(hw_phase == 1)
+        {
+            hw_twi_trans++;
+            for(t1 = 0; t1 < HW_DEVICES; t1++)
+            {
+                if(hw_dev_list[t1] && hw_dev_list[t1]->addr == b)
+                {
+                    hw_dev_cur = hw_dev_list[t1];
+                }
+            }
+            if(hw_dev_cur && hw_dev_cur->start)
+            {
+                hw_dev_cur->start();
+            }
+            TWSR = hw_dev_cur ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+            hw_phase = 2;
+        }
+        else
+        {
+            ack = hw_dev_cur && hw_dev_cur->write(b);
+            TWSR = ack ? TW_MT_DATA_ACK : TW_MT_DATA_NACK;
+        }
+    }
+    hw_twint = 1;
+    
+    return 1;
+}
+
+static void hw_isr(void (*vect)(void))
+{
+    SREG &= 0x7F;
+    vect();
+    SREG |= 0x80; //RETI
+}
+
+//Run peripherals and pending interrupts, at most 'max' events (< 0:
+//until nothing is left to do). Returns number of events
+int hw_poll_max(int max)
+{
+    int n = 0;
+    
+    if(hw_busy)
+    {
+        return 0;
+    }
+    hw_busy = 1;
+    while(n != max)
+    {
+        if(TIFR0 & (1 << OCF0A))
+        {
+            TIFR0 = 0;
+            hw_ocf0a = 0;
+        }
+        if(hw_twi())
+        {
+            n++;
+            continue;
+        }
+        if(!(SREG & 0x80))
+        {
+            break;
+        }
+        //In order of vector priority
+        if(hw_pcif2 && (PCICR & (1 << PCIE2)))
+        {
+            hw_pcif2 = 0; //Cleared by hardware on entering the ISR
+            hw_isr(PCINT2_vect);
+        }
+        else if((TIFR1 & (1 << OCF1A)) && (TIMSK1 & (1 << OCIE1A)))
+        {
+            TIFR1 &= ~(1 << OCF1A);
+            hw_isr(TIMER1_COMPA_vect);
+        }
+        else if(hw_adif && (ADCSRA & (1 << ADIE)))
+        {
+            hw_adif = 0;
+            hw_isr(ADC_vect);
+        }
+        else if(hw_twint && (TWCR & (1 << TWIE)))
+        {
+            hw_isr(TWI_vect);
+        }
+        else
+        {
+            break;
+        }
+        n++;
+    }
+    hw_busy = 0;
+    
+    return n;
+}
+
+int hw_poll(void)
+{
+    return hw_poll_max(-1);
+}
+
+static void hw_tick(int sig)
+{
+    (void) sig;
+    if(!hw_busy)
+    {
+        hw_advance(hw_tick_ns);
+    }
+    hw_poll();
+}
+
+//Start (us > 0) or stop periodic interrupts from SIGALRM
+//Each signal lets 'us' of simulated time pass
+void hw_run(int us)
+{
+    struct sigaction sa;
+    struct itimerval it;
+    
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = hw_tick;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &sa, 0);
+    hw_tick_ns = us * 1000ULL;
+    
+    memset(&it, 0, sizeof(it));
+    it.it_interval.tv_usec = us;
+    it.it_value.tv_usec = us;
+    setitimer(ITIMER_REAL, &it, 0);
+}
+
+//Power on state: interrupts enabled, EEPROM erased
+void hw_reset(void)
+{
+    memset((void *) hw_eeprom, 0xFF, sizeof(hw_eeprom));
+    hw_twint = 0;
+    hw_phase = 0;
+    hw_dev_cur = 0;
+    hw_adif = 0;
+    hw_ocf0a = 0;
+    hw_pcif2 = 0;
+    hw_pind_input = 0;
+    TWCR = 0;
+    TWSR = 0;
+    TCCR0B = 0;
+    TCCR1B = 0;
+    TIMSK1 = 0;
+    ADCSRA = 0;
+    PCICR = 0;
+    PCMSK2 = 0;
+    PIND = 0;
+    SREG = 0x80;
+}
@@ -0,0 +1,80 @@
+//Si5351 register model on the TWI bus
+//First byte of a transaction sets the register pointer, following bytes
+//are written with auto increment. Output frequencies are decoded from
+//the register contents (AN619), independent of the firmware math.
+
+uint8_t syn_reg[256];
+unsigned long syn_writes[256]; //Writes per register
+int syn_ptr, syn_first;
+
+static void syn_start(void)
+{
+    syn_first = 1;
+}
+
+static int syn_write(uint8_t b)
+{
+    if(syn_first)
+    {
+        syn_ptr = b;
+        syn_first = 0;
+    }
+    else
+    {
+        syn_writes[syn_ptr]++;
+        syn_reg[syn_ptr++ & 0xFF] = b;
+    }
+    return 1;
+}
+
+hw_dev syn_dev = {SI5351_ADDRESS, syn_start, syn_write, 0};
+
+//P1, P2, P3 of the 8 byte block at 'reg'
+void syn_params(int reg, uint32_t *p1, uint32_t *p2, uint32_t *p3)
+{
+    uint8_t *r = syn_reg + reg;
+    
+    *p3 = ((uint32_t) (r[5] & 0xF0) << 12) | (r[0] << 8) | r[1];
+    *p1 = ((uint32_t) (r[2] & 0x03) << 16) | (r[3] << 8) | r[4];
+    *p2 = ((uint32_t) (r[5] & 0x0F) << 16) | (r[6] << 8) | r[7];
+}
+
+//Division ratio a + b/c = (P1 + 512 + P2/P3) / 128
+long double syn_ratio(int reg)
+{
+    uint32_t p1, p2, p3;
+    
+    syn_params(reg, &p1, &p2, &p3);
+    if(!p3)
+    {
+        return 0;
+    }
+    return (p1 + 512 + (long double) p2 / p3) / 128;
+}
+
+//VCO frequency of the PLL feeding multisynth 'ms'
+long double syn_fvco(int ms)
+{
+    int pllb = syn_reg[CLK0_CONTROL + ms] & 0x20;
+    
+    return F_XTAL * syn_ratio(pllb ? SYNTH_PLL_B : SYNTH_PLL_A);
+}
+
+//Output frequency of multisynth 'ms' (0...2) incl. R divider
+long double syn_fout(int ms)
+{
+    int reg = SYNTH_MS_0 + 8 * ms;
+    long double div = syn_ratio(reg);
+    
+    if(div == 0)
+    {
+        return 0;
+    }
+    return syn_fvco(ms) / div / (1 << ((syn_reg[reg + 2] >> 4) & 7));
+}
+
+void syn_reset(void)
+{
+    memset(syn_reg, 0, sizeof(syn_reg));
+    memset(syn_writes, 0, sizeof(syn_writes));
+}
@@ -0,0 +1,197 @@
+//SSD1306 model on the TWI bus, 128 x 64 pixels
+//Interprets control bytes (Co, D/C), the addressing modes of command 0x20,
+//column/page windows 0x21/0x22 and the page mode pointer commands.
+//Other commands are only checked for their number of parameters.
+//Image orientation: column x of RAM is pixel x, bit n of page p is line
+//8 * p + n (segment remap and COM scan direction are not applied).
+
+uint8_t ssd_ram[8][128];
+int ssd_mode = 2;                    //0: horizontal, 1: vertical, 2: page
+int ssd_col, ssd_page;               //Address pointer
+int ssd_col0, ssd_col1 = 127;        //Window of horizontal/vertical mode
+int ssd_page0, ssd_page1 = 7;
+int ssd_ctrl = -1;                   //Control byte of stream, -1: expect control byte
+int ssd_cmd, ssd_args, ssd_need = 0; //Command waiting for parameters
+unsigned long ssd_data = 0, ssd_cmds = 0, ssd_unknown = 0;
+
+//Number of parameter bytes of command c
+static int ssd_params(int c)
+{
+    switch(c)
+    {
+        case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+        case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+            return 1;
+        case 0x21: case 0x22:
+            return 2;
+    }
+    if(c < 0x20 || (c >= 0x40 && c < 0x80) || (c >= 0xA0 && c <= 0xA7) ||
+       c == 0xAE || c == 0xAF || (c >= 0xB0 && c <= 0xB7) || c == 0xC0 || c == 0xC8)
+    {
+        return 0;
+    }
+    return -1;
+}
+
+static void ssd_command(uint8_t b)
+{
+    if(ssd_need)
+    {
+        ssd_args = (ssd_args << 8) | b;
+        if(--ssd_need)
+        {
+            return;
+        }
+        switch(ssd_cmd)
+        {
+            case 0x20:
+                ssd_mode = b & 3;
+                break;
+            case 0x21:
+                ssd_col0 = (ssd_args >> 8) & 0x7F;
+                ssd_col1 = b & 0x7F;
+                ssd_col = ssd_col0;
+                break;
+            case 0x22:
+                ssd_page0 = (ssd_args >> 8) & 7;
+                ssd_page1 = b & 7;
+                ssd_page = ssd_page0;
+                break;
+        }
+        return;
+    }
+    
+    ssd_cmds++;
+    ssd_cmd = b;
+    ssd_args = 0;
+    ssd_need = ssd_params(b);
+    if(ssd_need < 0)
+    {
+        ssd_unknown++;
+        ssd_need = 0;
+    }
+    if(ssd_mode == 2 && b < 0x10)
+    {
+        ssd_col = (ssd_col & 0xF0) | b;
+    }
+    else if(ssd_mode == 2 && b < 0x20)
+    {
+        ssd_col = (ssd_col & 0x0F) | ((b & 0x07) << 4);
+    }
+    else if(ssd_mode == 2 && b >= 0xB0 && b <= 0xB7)
+    {
+        ssd_page = b & 7;
+    }
+}
+
+static void ssd_write_ram(uint8_t b)
+{
+    ssd_data++;
+    ssd_ram[ssd_page][ssd_col] = b;
+    
+    if(ssd_mode == 0)
+    {
+        if(++ssd_col > ssd_col1)
+        {
+            ssd_col = ssd_col0;
+            if(++ssd_page > ssd_page1)
+            {
+                ssd_page = ssd_page0;
+            }
+        }
+    }
+    else if(ssd_mode == 1)
+    {
+        if(++ssd_page > ssd_page1)
+        {
+            ssd_page = ssd_page0;
+            if(++ssd_col > ssd_col1)
+            {
+                ssd_col = ssd_col0;
+            }
+        }
+    }
+    else
+    {
+        ssd_col = (ssd_col + 1) & 0x7F;
+    }
+}
+
+static void ssd_start(void)
+{
+    ssd_ctrl = -1;
+}
+
+static int ssd_write(uint8_t b)
+{
+    if(ssd_ctrl < 0)
+    {
+        ssd_ctrl = b;
+        return 1;
+    }
+    if(ssd_ctrl & 0x40)
+    {
+        ssd_write_ram(b);
+    }
+    else
+    {
+        ssd_command(b);
+    }
+    if(ssd_ctrl & 0x80) //Co set: next byte is a control byte again
+    {
+        ssd_ctrl = -1;
+    }
+    return 1;
+}
+
+hw_dev ssd_dev = {OLEDADDR, ssd_start, ssd_write, 0};
+
+//Pixel at x, y
+int ssd_pixel(int x, int y)
+{
+    return (ssd_ram[y >> 3][x] >> (y & 7)) & 1;
+}
+
+//Display RAM equals firmware frame buffer
+int ssd_matches_fb(void)
+{
+    return !memcmp(ssd_ram, oled_fb, sizeof(ssd_ram));
+}
+
+//Write display RAM as plain PBM (P1), returns 0 on error
+int ssd_write_pbm(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    int x, y;
+    
+    if(!f)
+    {
+        return 0;
+    }
+    fprintf(f, "P1\n128 64\n");
+    for(y = 0; y < 64; y++)
+    {
+        for(x = 0; x < 128; x++)
+        {
+            fputc('0' + ssd_pixel(x, y), f);
+            if(x == 63 || x == 127)
+            {
+                fputc('\n', f);
+            }
+        }
+    }
+    
+    return fclose(f) == 0;
+}
+
+void ssd_reset(void)
+{
+    memset(ssd_ram, 0, sizeof(ssd_ram));
+    ssd_mode = 2;
+    ssd_col = ssd_page = 0;
+    ssd_col0 = ssd_page0 = 0;
+    ssd_col1 = 127;
+    ssd_page1 = 7;
+    ssd_need = 0;
+    ssd_data = ssd_cmds = ssd_unknown = 0;
+}
@@ -0,0 +1,6 @@
+//1 KB EEPROM in SRAM, erased state 0xFF
+#include <stdint.h>
+uint8_t hw_eeprom[1024];
+#define eeprom_is_ready() 1
+#define eeprom_read_byte(p) (hw_eeprom[(uintptr_t) (p) & 1023])
+#define eeprom_write_byte(p, v) (hw_eeprom[(uintptr_t) (p) & 1023] = (v))
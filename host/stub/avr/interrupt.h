@@ -0,0 +1,4 @@
+//Interrupt flag in SREG, ISRs become plain functions called by hw.h
+#define ISR(vector) void vector(void); void vector(void)
+#define sei() (SREG |= 0x80)
+#define cli() (SREG &= 0x7F)
@@ -0,0 +1,60 @@
+//ATmega328p registers as plain variables for the host build
+//Peripherals are modelled in hw.h, SREG bit 7 is the interrupt flag
+#include <stdint.h>
+
+volatile uint8_t SREG;
+volatile uint8_t TWSR, TWBR, TWCR, TWDR;
+volatile uint8_t PIND, PORTB, PORTC, PORTD, DDRB;
+volatile uint8_t PCICR, PCMSK2, PCIFR;
+volatile uint8_t ADMUX, ADCSRA, ADCSRB;
+volatile uint16_t ADCW;
+volatile uint8_t TCCR0A, TCCR0B, OCR0A, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, OCR1AH, OCR1AL, TIMSK1, TIFR1;
+volatile uint16_t TCNT1;
+
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+
+#define PCIE2 2
+#define PCIF2 2
+#define PCINT21 5
+#define PCINT22 6
+
+#define REFS0 6
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define ADTS1 1
+#define ADTS0 0
+
+#define WGM01 1
+#define CS01 1
+#define CS00 0
+#define OCF0A 1
+#define WGM12 3
+#define CS12 2
+#define CS10 0
+#define OCIE1A 1
+#define OCF1A 1
+
+#define PB1 1
+#define PB2 2
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PD0 0
+#define PD5 5
+#define PD6 6
@@ -0,0 +1,6 @@
+//Flash and SRAM share one address space on the host
+#include <stdint.h>
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *) (p))
+#define pgm_read_word(p) (*(const uint16_t *) (p))
+#define pgm_read_dword(p) (*(const uint32_t *) (p))
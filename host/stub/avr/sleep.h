@@ -0,0 +1 @@
+//No sleep modes on the host
@@ -0,0 +1,3 @@
+//Busy waits take no time on the host
+#define _delay_ms(ms) ((void) 0)
+#define _delay_us(us) ((void) 0)
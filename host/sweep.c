@@ -0,0 +1,166 @@
+//Si5351 accuracy sweep
+//Tunes the VFO in 1 Hz steps over 13.999...14.4 MHz plus the IF, and sets
+//the LO frequencies, through si5351_set_freq() and the TWI queue. The
+//register stream goes to the Si5351 model (si5351.h), which decodes the
+//output frequency from P1/P2/P3. The range is split across all cores.
+//Usage: sweep [processes]
+#include "fw.h"
+#include "check.h"
+#include "si5351.h"
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define FMIN 13999000
+#define FMAX 14400000
+#define BINS 12       //Histogram of |error| in 0.025 Hz bins, last one open
+#define BINWIDTH 0.025
+
+typedef struct
+{
+    uint64_t n;
+    double worst;
+    long worst_f;
+    double sum, sumsq; //Signed error
+    uint64_t hist[BINS];
+    double ns;         //Time in si5351_set_freq()
+} result;
+
+static void add_error(result *r, long f, long double fout)
+{
+    double err = (double) (fout - f);
+    int bin = fabs(err) / BINWIDTH;
+    
+    r->n++;
+    r->sum += err;
+    r->sumsq += err * err;
+    r->hist[bin < BINS ? bin : BINS - 1]++;
+    if(fabs(err) > r->worst)
+    {
+        r->worst = fabs(err);
+        r->worst_f = f;
+    }
+}
+
+//Set synth, drain the queue and decode the result
+static void tune(result *r, int synth, long f)
+{
+    double t0 = check_ns();
+    
+    si5351_set_freq(synth, f);
+    r->ns += check_ns() - t0;
+    while(twi_state != TWI_IDLE)
+    {
+        hw_poll();
+    }
+    add_error(r, f, syn_fout((synth - SYNTH_MS_0) >> 3));
+}
+
+//Worker for frequencies f0...f1
+static void sweep(result *r, long f0, long f1, int lo)
+{
+    static const long f_lo_list[] = {F_LO_LSB, F_LO_USB};
+    long f;
+    
+    hw_reset();
+    syn_reset();
+    hw_attach(&syn_dev);
+    twi_init();
+    hw_run(20);
+    si5351_start();
+    twi_sync();
+    hw_run(0);
+    
+    memset(r, 0, sizeof(*r));
+    if(lo)
+    {
+        tune(r, SYNTH_MS_0, f_lo_list[0]);
+        tune(r, SYNTH_MS_0, f_lo_list[1]);
+    }
+    for(f = f0; f <= f1; f++)
+    {
+        tune(r, SYNTH_MS_1, f + INTERFREQUENCY);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int procs = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    int t1, t2, fd[2];
+    long span;
+    result r, total;
+    double t0 = check_ns(), clk, mean;
+    
+    if(procs < 1)
+    {
+        procs = 1;
+    }
+    
+    //Cost of the timer itself, subtracted from the per call time
+    clk = check_ns();
+    for(t1 = 0; t1 < 1000000; t1++)
+    {
+        check_ns();
+    }
+    clk = (check_ns() - clk) / 1000000;
+    
+    if(pipe(fd))
+    {
+        return 1;
+    }
+    span = (FMAX - FMIN + 1 + procs - 1) / procs;
+    for(t1 = 0; t1 < procs; t1++)
+    {
+        if(!fork())
+        {
+            long f0 = FMIN + t1 * span, f1 = f0 + span - 1;
+            sweep(&r, f0, f1 < FMAX ? f1 : FMAX, t1 == 0);
+            if(write(fd[1], &r, sizeof(r)) != sizeof(r))
+            {
+                _exit(1);
+            }
+            _exit(0);
+        }
+    }
+    close(fd[1]);
+    
+    memset(&total, 0, sizeof(total));
+    while(read(fd[0], &r, sizeof(r)) == sizeof(r))
+    {
+        total.n += r.n;
+        total.sum += r.sum;
+        total.sumsq += r.sumsq;
+        total.ns += r.ns;
+        for(t2 = 0; t2 < BINS; t2++)
+        {
+            total.hist[t2] += r.hist[t2];
+        }
+        if(r.worst >= total.worst)
+        {
+            total.worst = r.worst;
+            total.worst_f = r.worst_f;
+        }
+    }
+    while(wait(0) > 0);
+    
+    mean = total.sum / total.n;
+    printf("SYNTHOPTION %d, IF %d Hz, %d processes, %.1f s\n", SYNTHOPTION, INTERFREQUENCY, procs, (check_ns() - t0) / 1e9);
+    printf("%" PRIu64 " frequencies (VFO %d...%d Hz + IF in 1 Hz steps, LO)\n", total.n, FMIN, FMAX);
+    printf("worst error %.4f Hz at %ld Hz, mean %+.4f Hz, rms %.4f Hz\n",
+           total.worst, total.worst_f, mean, sqrt(total.sumsq / total.n));
+    printf("|error| Hz       count\n");
+    for(t2 = 0; t2 < BINS; t2++)
+    {
+        if(t2 < BINS - 1)
+        {
+            printf("%.3f-%.3f  %9" PRIu64 "\n", t2 * BINWIDTH, (t2 + 1) * BINWIDTH, total.hist[t2]);
+        }
+        else
+        {
+            printf("%.3f-       %9" PRIu64 "\n", t2 * BINWIDTH, total.hist[t2]);
+        }
+    }
+    printf("si5351_set_freq() %.1f ns/call on the host (math, shadow compare, queueing)\n",
+           total.ns / total.n - clk);
+    
+    return total.n != (uint64_t) (FMAX - FMIN + 1 + 2);
+}
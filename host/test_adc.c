@@ -0,0 +1,321 @@
+//ADC scanner against a mocked ADC: conversion rate per channel, results
+//stored under the right channel and complete rounds in the front buffer
+//Filters: IIR kernel step response, oversampling against noise
+//Meter peak hold fed from the conversion path, RX and TX slot
+//Temperature and voltage in integer math against the float formulas
+//Scan wait: S-meter sample after a retune comes from the new level only
+#include "fw.h"
+#include "check.h"
+
+//Conversion k gets round * 10 + slot, slot is the position in adc_chan[]
+long conv = 0;
+int mixed = 0;
+
+static int adc_input(int channel)
+{
+    int slot = conv % ADC_CHANNELS;
+
+    if(channel != pgm_read_byte(&adc_chan[slot]))
+    {
+        mixed++;
+    }
+    return ((conv++ / ADC_CHANNELS) % 100) * 10 + slot;
+}
+
+//Level per channel slot with noise of +/- 'noise'
+int level[ADC_CHANNELS], noise = 0;
+
+static int level_input(int channel)
+{
+    int t1, v = 0;
+
+    for(t1 = 0; t1 < ADC_CHANNELS; t1++)
+    {
+        if(channel == pgm_read_byte(&adc_chan[t1]))
+        {
+            v = level[t1];
+        }
+    }
+    if(noise)
+    {
+        v += rand() % (2 * noise + 1) - noise;
+    }
+    return v < 0 ? 0 : (v > 1023 ? 1023 : v);
+}
+
+static uint64_t now(void)
+{
+    return *(volatile uint64_t *) &hw_ns;
+}
+
+static void setup(int (*input)(int))
+{
+    hw_reset();
+    hw_adc_input = input;
+    conv = 0;
+    mixed = 0;
+    adc_idx = 0;
+    adc_round = 0;
+    hw_run(20);
+    adc_init();
+}
+
+//Conversions per channel and second for timer 0 top 'top', the ADC
+//clock from the prescaler within the 10 bit limit and fast enough for
+//one conversion (13 ADC clocks) per trigger
+static void test_rate(int top)
+{
+    uint16_t n0[ADC_CHANNELS];
+    uint64_t t0;
+    double rate, expect, adc_clk;
+    int t1;
+
+    setup(adc_input);
+    OCR0A = top;
+    adc_clk = (double) F_CPU / (1 << (ADCSRA & 7));
+    CHECK(adc_clk <= 200000 && 13 / adc_clk < (top + 1) * 64.0 / F_CPU);
+    cli();
+    t0 = now();
+    for(t1 = 0; t1 < ADC_CHANNELS; t1++)
+    {
+        n0[t1] = adc_samples[t1];
+    }
+    sei();
+    while(now() - t0 < 500000000ULL);
+
+    cli();
+    for(t1 = 0; t1 < ADC_CHANNELS; t1++)
+    {
+        rate = (uint16_t) (adc_samples[t1] - n0[t1]) * 1e9 / (now() - t0);
+        expect = (double) F_CPU / 64 / (top + 1) / ADC_CHANNELS;
+        CHECK(fabs(rate - expect) < expect / 100);
+        if(!t1)
+        {
+            printf("adc: timer top %d, %.0f conversions/s per channel, ADC clock %.0f kHz\n",
+                   top, rate, adc_clk / 1000);
+        }
+    }
+    sei();
+    hw_run(0);
+    CHECK(!mixed);
+}
+
+//Front buffer always holds one complete round, getters return the
+//value of their own channel
+static void test_rounds(void)
+{
+    uint16_t r[ADC_CHANNELS];
+    uint64_t t0;
+    long reads = 0;
+    int t1, v;
+
+    setup(adc_input);
+    t0 = now();
+    while(now() - t0 < 200000000ULL)
+    {
+        cli();
+        for(t1 = 0; t1 < ADC_CHANNELS; t1++)
+        {
+            r[t1] = adc_res[adc_front][t1];
+        }
+        sei();
+        for(t1 = 0; t1 < ADC_CHANNELS; t1++)
+        {
+            CHECK(r[t1] % 10 == t1 && r[t1] / 10 == r[0] / 10);
+        }
+        t1 = rand() % ADC_CHANNELS;
+        v = get_adc(pgm_read_byte(&adc_chan[t1]));
+        CHECK(v % 10 == t1);
+        reads++;
+        if(check_failed)
+        {
+            break;
+        }
+    }
+    hw_run(0);
+    CHECK(!mixed);
+    printf("adc: %ld reads without waiting, %ld conversions\n", reads, conv);
+}
+
+//Filter kernel alone: from any start to any target without overflow,
+//monotonic, ends at the target
+static void test_iir(void)
+{
+    int slot, x0, x, n, n_up = 0, n_down = 0, bad = 0;
+    int16_t s, s1;
+
+    for(slot = 0; slot < ADC_CHANNELS; slot++)
+    {
+        for(x0 = 0; x0 < 1024; x0 += 31)
+        {
+            for(x = 0; x < 1024; x += 29)
+            {
+                s = x0 << ADC_FRAC;
+                for(n = 0; n < 2000; n++)
+                {
+                    s1 = adc_iir(s, x, slot);
+                    if((s1 - s) * (x - x0) < 0 || s1 < 0 || s1 > (1023 << ADC_FRAC))
+                    {
+                        bad++;
+                    }
+                    if(s1 == s)
+                    {
+                        break;
+                    }
+                    s = s1;
+                }
+                CHECK(((s + (1 << (ADC_FRAC - 1))) >> ADC_FRAC) == x);
+                if(!pgm_read_byte(&adc_attack[slot]) && x > x0)
+                {
+                    CHECK(n == 1);
+                }
+            }
+        }
+    }
+
+    CHECK(!bad);
+
+    //S-meter from 0 to full scale and back, samples until within 1 LSB
+    for(s = 0; ((s + (1 << (ADC_FRAC - 1))) >> ADC_FRAC) < 1022; n_up++)
+    {
+        s = adc_iir(s, 1023, 1);
+    }
+    for(; ((s + (1 << (ADC_FRAC - 1))) >> ADC_FRAC) > 1; n_down++)
+    {
+        s = adc_iir(s, 0, 1);
+    }
+    CHECK(n_up < n_down);
+    printf("adc: S-meter 0 > 1023 in %d samples, back in %d\n", n_up, n_down);
+}
+
+//Conversions one by one from the ADC model
+static void convert(int n)
+{
+    while(n--)
+    {
+        hw_advance((OCR0A + 1) * 4000ULL);
+        hw_poll();
+    }
+}
+
+//Noisy S-meter: raw and smoothed deviation from the level
+static void test_noise(void)
+{
+    double d, raw = 0, smooth = 0;
+    int t1, n = 2000;
+
+    memset(level, 0, sizeof(level));
+    level[1] = 500;
+    setup(level_input);
+    hw_run(0);
+    convert(ADC_CHANNELS * 200);
+    noise = 20;
+    for(t1 = 0; t1 < n; t1++)
+    {
+        convert(ADC_CHANNELS);
+        d = get_adc_val(1, ADC_RAW) - 500;
+        raw += d * d;
+        d = get_adc_val(1, ADC_SMOOTH) - 500;
+        smooth += d * d;
+        CHECK(fabs(d) <= 20);
+    }
+    noise = 0;
+    raw = sqrt(raw / n);
+    smooth = sqrt(smooth / n);
+    CHECK(smooth < raw / 2);
+    printf("adc: noise +/-20, S-meter deviation raw %.1f, smoothed %.1f LSB (rms)\n", raw, smooth);
+}
+
+//Short pulse between two loop passes reaches the meter peak without any
+//read of the ADC; only the slot of the current RX/TX state counts
+static void test_meter_peak(void)
+{
+    memset(level, 0, sizeof(level));
+    level[ADC_SLOT_S] = 100;
+    level[ADC_SLOT_PWR] = 10;
+    setup(level_input);
+    hw_run(0);
+    convert(ADC_CHANNELS * ADC_OVERSAMPLE * 4); //Sums of the last test flushed
+    meter_peak_reset(0);
+    convert(ADC_CHANNELS * ADC_OVERSAMPLE * 4);
+    CHECK((peak_val >> 8) == meter_cols(ADC_SLOT_S, 100));
+    
+    level[ADC_SLOT_S] = 200;
+    convert(ADC_CHANNELS * ADC_OVERSAMPLE * 2);
+    level[ADC_SLOT_S] = 100;
+    convert(ADC_CHANNELS * ADC_OVERSAMPLE * 4);
+    CHECK((peak_val >> 8) == meter_cols(ADC_SLOT_S, 200) && peak_hold == PEAK_HOLD);
+    
+    //TX: S-meter pulses are ignored, TX power counts
+    meter_peak_reset(1);
+    level[ADC_SLOT_S] = 300;
+    convert(ADC_CHANNELS * ADC_OVERSAMPLE * 2);
+    CHECK((peak_val >> 8) == meter_cols(ADC_SLOT_PWR, 10));
+    level[ADC_SLOT_PWR] = 40;
+    convert(ADC_CHANNELS * ADC_OVERSAMPLE * 2);
+    CHECK((peak_val >> 8) == meter_cols(ADC_SLOT_PWR, 40));
+    meter_peak_reset(0);
+}
+
+//Every ADC value gives what the float formulas gave, the temperature
+//limited to 999; open sensor (1023) reads like 1022
+static void test_scaling(void)
+{
+    double ux, t;
+    int adc;
+
+    for(adc = 0; adc < 1023; adc++)
+    {
+        CHECK(adc2volt(adc) == (int) ((double) adc * 5 / 1024 * 5 * 10));
+        ux = (double) (5 * adc) / 1023;
+        t = (3000 / (5 / ux - 1) - 1630) / 17.62;
+        CHECK(adc2temp(adc) == (t > 999 ? 999 : (int) t));
+    }
+    CHECK(adc2temp(1023) == adc2temp(1022));
+}
+
+//Level jumps at the moment of a retune: after adc_wait_sample() the
+//smoothed S-meter has taken at least one full filter step towards the
+//new level (attack shift 1: half way), within 8 rounds
+static void test_wait_sample(void)
+{
+    uint64_t t0, worst = 0;
+    int t1, v;
+
+    memset(level, 0, sizeof(level));
+    level[ADC_SLOT_S] = 100;
+    setup(level_input);
+    for(t1 = 0; t1 < 50; t1++)
+    {
+        t0 = now();
+        while(now() - t0 < rand() % 5000000); //Random phase
+        cli();
+        adc_filt[ADC_SLOT_S] = 100 << ADC_FRAC;
+        level[ADC_SLOT_S] = 900;
+        sei();
+        t0 = now();
+        adc_wait_sample();
+        t0 = now() - t0;
+        worst = t0 > worst ? t0 : worst;
+        v = get_adc_val(1, ADC_SMOOTH);
+        CHECK(v >= 500);
+        level[ADC_SLOT_S] = 100;
+    }
+    hw_run(0);
+    CHECK(worst <= 8 * ADC_CHANNELS * (ADC_TIMER_TOP + 1) * 4000ULL);
+    printf("adc: fresh S-meter sample after a retune within %.1f ms\n", worst / 1e6);
+}
+
+int main(void)
+{
+    test_rate(ADC_TIMER_TOP);
+    test_rate(249);
+    test_rounds();
+    test_iir();
+    test_noise();
+    test_meter_peak();
+    test_scaling();
+    test_wait_sample();
+
+    return check_result("test_adc");
+}
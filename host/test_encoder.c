@@ -0,0 +1,247 @@
+//Encoder decoder: recorded pin sequences with bounce through the pin
+//change interrupt, random traces, and steps taken by the main program
+//while interrupts hit it at random points
+//Tuning acceleration: Hz per detent for synthetic timing profiles
+#include "fw.h"
+#include "check.h"
+
+//Gray code in turning direction, pins PD6:PD5
+static const uint8_t gray[4] = {0, 1, 3, 2};
+
+static void setup(uint8_t pins)
+{
+    hw_reset();
+    hw_pins(pins << 5);
+    PCMSK2 |= ((1<<PCINT21) | (1<<PCINT22));
+    PCICR |= (1<<PCIE2);
+    laststate = (PIND & 0x60) >> 5;
+    tuningknob = 0;
+    enc_dt = ENC_DT_MAX;
+    enc_dir = 0;
+    TCCR1B = (1 << CS10) | (1 << CS12) | (1<<WGM12);
+    TIMSK1 |= (1<<OCIE1A);
+}
+
+//Pin states as digits, one pin change interrupt per state
+static int replay(const char *seq)
+{
+    setup(*seq++ - '0');
+    while(*seq)
+    {
+        hw_pins((*seq++ - '0') << 5);
+        hw_poll();
+        hw_advance(100000);
+    }
+    return tuningknob;
+}
+
+//Recorded sequences: {pin states, transitions}
+static void test_recorded(void)
+{
+    static const struct
+    {
+        const char *seq;
+        int steps;
+    } rec[] = {{"01320", 4},              //One detent
+               {"02310", -4},             //One detent back
+               {"0101320", 4},            //Bounce on PD5
+               {"01313132020", 4},        //Bounce on PD6 and PD5
+               {"0132013201", 9},         //Two detents and one transition
+               {"01310", 0},              //Half a detent and back
+               {"0132310", 0},            //Turned back at the last transition
+               {"0320", 2},               //Both pins changed (missed edge), counts neither way
+               {"01010101010101010", 0},  //Bounce only
+               {"0231023101320", -4}};
+    unsigned int t1;
+    int n;
+
+    for(t1 = 0; t1 < sizeof(rec) / sizeof(rec[0]); t1++)
+    {
+        n = replay(rec[t1].seq);
+        if(n != rec[t1].steps)
+        {
+            printf("\"%s\": %d steps, expected %d\n", rec[t1].seq, n, rec[t1].steps);
+            CHECK(0);
+        }
+    }
+}
+
+//Random trace: runs of steps in one direction, a pin may bounce back
+//once or several times before it settles
+#define TRACE_LEN 200000
+uint8_t trace[TRACE_LEN];
+int trace_len, trace_net;
+
+static void make_trace(int len)
+{
+    int t1 = 1, pos = 0, d = 1, run = 0, b;
+
+    trace[0] = 0;
+    trace_len = len;
+    trace_net = 0;
+    while(t1 < len - 20)
+    {
+        if(!run--)
+        {
+            d = (rand() & 1) ? 1 : -1;
+            run = rand() % 40;
+        }
+        for(b = (rand() % 4) ? 0 : rand() % 4; b > 0; b--)
+        {
+            trace[t1++] = gray[(pos + d) & 3];
+            trace[t1++] = gray[pos];
+        }
+        pos = (pos + d) & 3;
+        trace[t1++] = gray[pos];
+        trace_net += d;
+    }
+    while(t1 < len)
+    {
+        trace[t1++] = gray[pos];
+    }
+}
+
+//Every state of the trace through the interrupt
+static void test_random_trace(void)
+{
+    int t1;
+
+    make_trace(TRACE_LEN);
+    setup(trace[0]);
+    for(t1 = 1; t1 < trace_len; t1++)
+    {
+        hw_pins(trace[t1] << 5);
+        hw_poll();
+    }
+    CHECK(tuningknob == trace_net);
+}
+
+//Trace played from timer signals, one state per 100us of simulated time
+#define TRACE_NS 100000ULL
+uint64_t trace_t0;
+
+static uint8_t trace_pins(uint64_t ns)
+{
+    uint64_t t1 = (ns - trace_t0) / TRACE_NS;
+
+    return trace[t1 < trace_len ? t1 : trace_len - 1] << 5;
+}
+
+//Main program takes steps with encoder_take() and encoder_detents()
+//while the interrupt adds to the same counter, some work in between
+//like in the main loop
+static void test_concurrent(void)
+{
+    volatile uint64_t *ns = &hw_ns;
+    volatile int work;
+    long taken = 0, calls = 0;
+    int n;
+
+    make_trace(20000);
+    setup(trace[0]);
+    trace_t0 = hw_ns;
+    hw_pind_input = trace_pins;
+    hw_run(20);
+    while(*ns < trace_t0 + trace_len * TRACE_NS)
+    {
+        for(work = rand() % 100; work > 0; work--);
+        if(rand() & 1)
+        {
+            taken += encoder_take(rand() % 3);
+        }
+        else
+        {
+            n = encoder_detents();
+            taken += n * ENC_DETENT;
+        }
+        calls++;
+    }
+    hw_run(0);
+    taken += encoder_take(0);
+    CHECK(taken == trace_net);
+    printf("encoder: %d transitions, %ld reads from main program, none lost\n", trace_net, calls);
+}
+
+//Turn by whole detents at 'ms' per detent (dir +1/-1), the main
+//program takes detents after every transition like the tuning loop.
+//Returns Hz tuned, Hz per detent of the last detent in *hz.
+static long turn(int detents, double ms, int dir, int *hz)
+{
+    int t1, n, pos = 0;
+    long f = 0;
+
+    while(gray[pos] != laststate)
+    {
+        pos++;
+    }
+    for(t1 = 0; t1 < detents * ENC_DETENT; t1++)
+    {
+        hw_advance(ms * 1e6 / ENC_DETENT);
+        hw_poll();
+        pos = (pos + dir) & 3;
+        hw_pins(gray[pos] << 5);
+        hw_poll();
+        n = encoder_detents();
+        if(n)
+        {
+            *hz = -calc_tuningfactor();
+            f += (long) n * *hz;
+        }
+    }
+    return f;
+}
+
+//Profiles: {ms per detent, Hz per detent at the end}
+static void test_acceleration(void)
+{
+    static const struct
+    {
+        double ms;
+        int hz;
+    } prof[] = {{300, 10}, {200, 10}, {100, 20}, {40, 100}, {15, 500}, {5, 2500}, {2, 2500}};
+    unsigned int t1;
+    int hz = 0;
+    long f;
+
+    printf("ms/detent  Hz/detent  kHz/s\n");
+    for(t1 = 0; t1 < sizeof(prof) / sizeof(prof[0]); t1++)
+    {
+        setup(0);
+        turn(40, prof[t1].ms, 1, &hz);
+        CHECK(hz == prof[t1].hz);
+        CHECK(tuningknob == 0);
+        printf("%9.0f %10d %6.2f\n", prof[t1].ms, hz, hz / prof[t1].ms);
+    }
+
+    //Slow turning: exactly one step per detent, both directions
+    setup(0);
+    f = turn(100, 300, 1, &hz);
+    CHECK(f == 1000);
+    f = turn(100, 300, -1, &hz);
+    CHECK(f == -1000);
+
+    //Single detent after spinning, or when turning back, is a fine step
+    setup(0);
+    turn(200, 3, 1, &hz);
+    CHECK(hz == 2500);
+    f = turn(1, 500, 1, &hz);
+    CHECK(f == 10);
+    turn(200, 3, 1, &hz);
+    f = turn(1, 100, -1, &hz);
+    CHECK(f == -10);
+
+    //Transitions one by one with long pauses still add up to detents
+    setup(0);
+    f = turn(3, 4000, 1, &hz);
+    CHECK(f == 30 && tuningknob == 0);
+}
+
+int main(void)
+{
+    test_recorded();
+    test_random_trace();
+    test_concurrent();
+    test_acceleration();
+
+    return check_result("test_encoder");
+}
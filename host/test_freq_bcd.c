@@ -0,0 +1,131 @@
+//BCD frequency counter of show_frequency() against the int2asc()
+//formatting it replaced, for random tuning steps, jumps and refreshes
+//(VFO swap, memory recall), plus characters redrawn per step
+#include "fw.h"
+#include "check.h"
+
+#define FMIN 1000000
+#define FMAX 30000000
+
+//Field as the old show_frequency() built it, padded to full width
+static void expected(long f, char *buf)
+{
+    char s[16];
+    int t1, n = int2asc(f / 10, 2, s, 16);
+
+    for(t1 = 0; t1 < FREQDIGITS; t1++)
+    {
+        buf[t1] = t1 < n ? s[t1] : 32;
+    }
+}
+
+//Counter digits against the frequency
+static int bcd_matches(long f)
+{
+    int t1;
+
+    for(t1 = 0; t1 < FREQBCDDIGITS; t1++)
+    {
+        if(freq_bcd_get(t1) != f % 10)
+        {
+            return 0;
+        }
+        f /= 10;
+    }
+    return freq_bcd_f != 0;
+}
+
+//Random step: mostly encoder steps, sometimes a jump (band edge, memory)
+static long random_step(void)
+{
+    static const long size[] = {1, 10, 20, 50, 100, 500, 2500, 99999, 100000, 7000000};
+    long d = size[rand() % 10];
+
+    if(rand() & 1)
+    {
+        d = rand() % d + 1;
+    }
+    return (rand() & 1) ? d : -d;
+}
+
+static void test_random_steps(void)
+{
+    char buf[FREQDIGITS];
+    long f = 14200000, d, n;
+
+    show_frequency(f, 1);
+    for(n = 0; n < 2000000; n++)
+    {
+        d = random_step();
+        if(f + d < FMIN || f + d > FMAX)
+        {
+            d = -d;
+        }
+        f += d;
+        show_frequency(f, !(rand() % 50));
+        expected(f, buf);
+        if(memcmp(freq_digits, buf, FREQDIGITS) || !bcd_matches(f))
+        {
+            printf("f %ld d %ld: \"%.8s\", expected \"%.8s\"\n", f, d, freq_digits, buf);
+            CHECK(0);
+            return;
+        }
+    }
+}
+
+//Carry and borrow through every digit, shorter number after longer one
+static void test_edges(void)
+{
+    static const long f[] = {9999999, 10000000, 9999999, 10000009, 9999990,
+                             14200000, 7000000, 14199990, 14200000, 1000000, 999990};
+    char buf[FREQDIGITS];
+    unsigned int t1;
+
+    show_frequency(f[0], 1);
+    for(t1 = 1; t1 < sizeof(f) / sizeof(f[0]); t1++)
+    {
+        show_frequency(f[t1], 0);
+        expected(f[t1], buf);
+        CHECK(!memcmp(freq_digits, buf, FREQDIGITS));
+        CHECK(bcd_matches(f[t1]));
+    }
+
+    //Blank field, next call starts from scratch
+    show_frequency(0, 0);
+    CHECK(freq_bcd_f == 0);
+    show_frequency(14200010, 0);
+    expected(14200010, buf);
+    CHECK(!memcmp(freq_digits, buf, FREQDIGITS) && bcd_matches(14200010));
+}
+
+//Mean number of characters redrawn per encoder step
+static void count_redraw(long step)
+{
+    char last[FREQDIGITS];
+    long f = 14000000, n, chars = 0;
+    int t1;
+
+    show_frequency(f, 1);
+    for(n = 0; n < 10000; n++)
+    {
+        memcpy(last, freq_digits, FREQDIGITS);
+        f += step;
+        show_frequency(f, 0);
+        for(t1 = 0; t1 < FREQDIGITS; t1++)
+        {
+            chars += last[t1] != freq_digits[t1];
+        }
+    }
+    printf("%6ld Hz steps: %.2f characters redrawn per step\n", step, (double) chars / n);
+}
+
+int main(void)
+{
+    test_edges();
+    test_random_steps();
+    count_redraw(10);
+    count_redraw(100);
+    count_redraw(2500);
+
+    return check_result("test_freq_bcd");
+}
@@ -0,0 +1,287 @@
+//int2asc() against the division based version it replaced
+//Default: every value from -2^21 to 2^25 (all frequencies and readings
+//shown) with the dec values in use, plus powers of ten and random values
+//over the full 32 bit range
+//buflen: output cut to buflen - 1 characters, nothing written behind
+//AVR cost estimated from the operations, the host timing has a hardware
+//divider and does not show it
+//-x: every 32 bit value (takes long)
+#include "fw.h"
+#include "check.h"
+
+//Baseline, copied from the firmware before the change (long = 32 bit)
+//buf must have room in front of it: 10 digit negatives write buf[-1]
+static int old_int2asc(int32_t num, int dec, char *buf, int buflen)
+{
+    int i, c, xp = 0, neg = 0;
+    int32_t n, dd = 1E09;
+
+    if(!num)
+	{
+	    *buf++ = '0';
+		*buf = 0;
+		return 1;
+	}
+
+    if(num < 0)
+    {
+     	neg = 1;
+	    n = num * -1;
+    }
+    else
+    {
+	    n = num;
+    }
+
+    //Fill buffer with \0
+    for(i = 0; i < 12; i++)
+    {
+	    *(buf + i) = 0;
+    }
+
+    c = 9; //Max. number of displayable digits
+    while(dd)
+    {
+	    i = n / dd;
+	    n = n - i * dd;
+
+	    *(buf + 9 - c + xp) = i + 48;
+	    dd /= 10;
+	    if(c == dec && dec)
+	    {
+	        *(buf + 9 - c + ++xp) = '.';
+	    }
+	    c--;
+    }
+
+    //Search for 1st char different from '0'
+    i = 0;
+    while(*(buf + i) == 48)
+    {
+	    *(buf + i++) = 32;
+    }
+
+    //Add minus-sign if neccessary
+    if(neg)
+    {
+	    *(buf + --i) = '-';
+    }
+
+    //Eleminate leading spaces
+    c = 0;
+    while(*(buf + i))
+    {
+	    *(buf + c++) = *(buf + i++);
+    }
+    *(buf + c) = 0;
+
+	return c;
+}
+
+static const int decs[] = {-1, 0, 1, 2, 3};
+#define NDECS (sizeof(decs) / sizeof(decs[0]))
+
+static long compared = 0;
+
+static void compare(int32_t n, int dec)
+{
+    char o[20], b[16];
+    int lo, ln;
+
+    //Outside the old function's range: -2^31 overflows on negation,
+    //10 digit negatives put the sign in front of the buffer
+    if(n == INT32_MIN || n <= -1000000000)
+    {
+        ln = int2asc(n, dec, b, 16);
+        CHECK(b[0] == '-' && ln == fw_strlen(b));
+        return;
+    }
+
+    lo = old_int2asc(n, dec, o + 1, 16);
+    ln = int2asc(n, dec, b, 16);
+    compared++;
+    if(lo != ln || strcmp(o + 1, b))
+    {
+        CHECK(!strcmp(o + 1, b));
+        printf("  n=%d dec=%d old \"%s\" new \"%s\"\n", n, dec, o + 1, b);
+        if(check_failed > 20)
+        {
+            exit(1);
+        }
+    }
+}
+
+static uint32_t rnd = 1;
+
+static uint32_t xorshift(void)
+{
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    return rnd;
+}
+
+static void test_range(int64_t from, int64_t to)
+{
+    int64_t n;
+    unsigned int d;
+
+    for(n = from; n < to; n++)
+    {
+        for(d = 0; d < NDECS; d++)
+        {
+            compare((int32_t) n, decs[d]);
+        }
+    }
+}
+
+//dec values the firmware uses (0 is the same as -1)
+static void test_shown(int64_t from, int64_t to)
+{
+    int64_t n;
+
+    for(n = from; n < to; n++)
+    {
+        compare((int32_t) n, -1);
+        compare((int32_t) n, 1);
+        compare((int32_t) n, 2);
+    }
+}
+
+static void test_edges(void)
+{
+    int64_t p;
+    int k;
+    unsigned int d;
+
+    for(p = 1; p <= 1000000000; p *= 10)
+    {
+        test_range(p - 3, p + 3);
+        test_range(-p - 3, -p + 3);
+        test_range(2 * p - 1, 2 * p + 1);
+        test_range(10 * p - 1 - 3, 10 * p - 1 + 1);
+    }
+    test_range(INT32_MAX - 3, (int64_t) INT32_MAX + 1);
+    test_range(INT32_MIN, (int64_t) INT32_MIN + 3);
+
+    for(k = 0; k < 2000000; k++)
+    {
+        for(d = 0; d < NDECS; d++)
+        {
+            compare((int32_t) xorshift(), decs[d]);
+        }
+    }
+}
+
+//Every buffer length gives the start of the full string, the bytes
+//behind the buffer stay untouched
+static void test_buflen(void)
+{
+    static const int32_t v[] = {0, 7, -7, 125, -125, 14200000, -1000000000, INT32_MAX, INT32_MIN};
+    char full[16], b[20];
+    unsigned int t1, d;
+    int len, n, k;
+
+    for(t1 = 0; t1 < sizeof(v) / sizeof(v[0]); t1++)
+    {
+        for(d = 0; d < NDECS; d++)
+        {
+            len = int2asc(v[t1], decs[d], full, 16);
+            for(n = 0; n <= 16; n++)
+            {
+                memset(b, 0x55, sizeof(b));
+                k = int2asc(v[t1], decs[d], b, n);
+                CHECK(k == (n ? (len < n - 1 ? len : n - 1) : 0));
+                CHECK(!n || (!memcmp(b, full, k) && !b[k]));
+                CHECK(b[n] == 0x55 && b[19] == 0x55);
+            }
+        }
+    }
+}
+
+//Mean time per call over a set of typical display values
+static double time_call(int old)
+{
+    char b[20];
+    int32_t n;
+    int k, s = 0;
+    double t0;
+
+    t0 = check_ns();
+    for(k = 0; k < 20; k++)
+    {
+        for(n = 14000000; n < 14100000; n += 7)
+        {
+            s += old ? old_int2asc(n, 2, b + 1, 16) : int2asc(n, 2, b, 16);
+        }
+    }
+    if(!s)
+    {
+        printf("\n");
+    }
+    return (check_ns() - t0) / (20 * (100000 / 7 + 1));
+}
+
+//Operations per call of the new code: subtractions of a power of ten.
+//AVR estimate (not measured, no simulator here): the old code makes 20
+//calls of libgcc's __udivmodsi4, a shift and subtract loop of 32 steps
+//at about 20 cycles; one 32 bit compare and subtract step of the new
+//code takes about 12 cycles, reading a power of ten from flash about 20.
+#define AVR_DIV_CYCLES (32 * 20)
+#define AVR_SUB_CYCLES 12
+#define AVR_DIGIT_CYCLES 20
+
+static void count_ops(void)
+{
+    int32_t n;
+    long subs = 0, calls = 0, worst = 0;
+    uint32_t m, p;
+    int c, s;
+
+    for(n = 1; n < 30000000; n += 13)
+    {
+        m = n;
+        s = 0;
+        for(c = 0; c < 10; c++)
+        {
+            p = pgm_read_dword(&pow10tab[c]);
+            while(m >= p)
+            {
+                m -= p;
+                s++;
+            }
+        }
+        subs += s;
+        worst = s > worst ? s : worst;
+        calls++;
+    }
+    printf("int2asc: 0 divisions (old: 20 32-bit divisions), %.1f subtractions per call, worst %ld (1...3*10^7)\n",
+           (double) subs / calls, worst);
+    printf("int2asc: AVR estimate old ~%d cycles, new ~%.0f mean, ~%ld worst\n", 20 * AVR_DIV_CYCLES,
+           (double) subs / calls * AVR_SUB_CYCLES + 10 * AVR_DIGIT_CYCLES,
+           worst * AVR_SUB_CYCLES + 10 * AVR_DIGIT_CYCLES);
+}
+
+int main(int argc, char **argv)
+{
+    double t_old, t_new;
+
+    if(argc > 1 && !strcmp(argv[1], "-x"))
+    {
+        test_range(INT32_MIN, (int64_t) INT32_MAX + 1);
+    }
+    else
+    {
+        test_shown(-(1 << 21), 1 << 25);
+        test_edges();
+    }
+    printf("int2asc: %ld comparisons with the old version\n", compared);
+    test_buflen();
+
+    count_ops();
+    t_old = time_call(1);
+    t_new = time_call(0);
+    printf("int2asc: old %.1f ns, new %.1f ns per call (host, hardware divider)\n", t_old, t_new);
+
+    return check_result("test_int2asc");
+}
@@ -0,0 +1,201 @@
+//Latency histograms (built with -DLATENCYSTATS=1) from a replayed
+//encoder trace: the tuning part of the main loop runs against the
+//Si5351 and SSD1306 models, the report shows the histograms per stage
+//like the debug screen.
+//Usage: test_latency [trace]
+//Trace file: one segment per line "ms_per_detent detents", negative
+//detents turn down, 0 detents is a pause of ms_per_detent.
+#include "fw.h"
+#include "check.h"
+#include "si5351.h"
+#include "ssd1306.h"
+
+#if (LATENCYSTATS != 1)
+#error "Build with -DLATENCYSTATS=1"
+#endif
+
+//Gray code in turning direction, pins PD6:PD5
+static const uint8_t gray[4] = {0, 1, 3, 2};
+
+//Default trace: slow tuning, spinning up and down, turning back
+static const double trace_default[][2] = {{300, 10}, {0, 500}, {100, -20}, {20, 50}, {5, 200},
+                                          {2, 300}, {0, 200}, {40, -30}, {300, 5}, {0, 300},
+                                          {1, -500}, {0, 500}, {200, 3}};
+
+//Pin state at each transition
+#define EDGES 100000
+uint64_t edge_ns[EDGES];
+uint8_t edge_pins[EDGES];
+int edges = 0;
+long trace_detents = 0;
+
+//Add segment to list of transitions, time from start of trace
+static void trace_add(double ms, double detents)
+{
+    static uint64_t t = 0;
+    static int pos = 0;
+    int n = fabs(detents) * ENC_DETENT, dir = detents < 0 ? -1 : 1;
+
+    if(!n)
+    {
+        t += ms * 1e6;
+        return;
+    }
+    while(n-- && edges < EDGES)
+    {
+        t += ms * 1e6 / ENC_DETENT;
+        pos = (pos + dir) & 3;
+        edge_ns[edges] = t;
+        edge_pins[edges++] = gray[pos] << 5;
+    }
+    trace_detents += fabs(detents);
+}
+
+static int trace_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    double ms, d;
+
+    if(!f)
+    {
+        return 0;
+    }
+    while(fscanf(f, "%lf %lf", &ms, &d) == 2)
+    {
+        trace_add(ms, d);
+    }
+    fclose(f);
+    return 1;
+}
+
+uint64_t trace_t0;
+
+static uint8_t trace_pins(uint64_t ns)
+{
+    static int e = 0;
+
+    while(e < edges && edge_ns[e] <= ns - trace_t0)
+    {
+        e++;
+    }
+    return e ? edge_pins[e - 1] : gray[0] << 5;
+}
+
+static uint64_t now(void)
+{
+    return *(volatile uint64_t *) &hw_ns;
+}
+
+static void setup(void)
+{
+    hw_reset();
+    ssd_reset();
+    syn_reset();
+    hw_attach(&ssd_dev);
+    hw_attach(&syn_dev);
+    twi_init();
+    hw_run(20);
+
+    hw_pins(gray[0] << 5);
+    PCMSK2 |= ((1<<PCINT21) | (1<<PCINT22));
+    PCICR |= (1<<PCIE2);
+    laststate = (PIND & 0x60) >> 5;
+    TCCR1B = (1 << CS10) | (1 << CS12) | (1<<WGM12);
+    TIMSK1 |= (1<<OCIE1A);
+
+    si5351_start();
+    oled_init();
+    oled_cls(0);
+    cur_vfo = 0;
+    f_vfo[0] = 14200000;
+    set_vfo_frequency(f_vfo[0] + INTERFREQUENCY);
+    show_frequency(f_vfo[0], 1);
+    draw_meter_scale(0);
+    oled_flush();
+    twi_sync();
+}
+
+//Tuning part of the main loop until the trace has been played
+static void replay(void)
+{
+    uint64_t end = edge_ns[edges - 1] + 500000000ULL;
+
+    trace_t0 = now();
+    hw_pind_input = trace_pins;
+    while(now() - trace_t0 < end)
+    {
+        tune_vfo(0);
+        oled_flush_budget();
+        lat_check(f_vfo[cur_vfo]);
+    }
+    hw_pind_input = 0;
+}
+
+//Per stage: name, number of samples and count per bucket
+static void report(void)
+{
+    int s, b;
+    long n;
+
+    printf("stage   samples  bucket (ms from encoder edge): count\n");
+    for(s = 0; s < LAT_STAGES; s++)
+    {
+        n = 0;
+        for(b = 0; b < LAT_BUCKETS; b++)
+        {
+            n += lat_hist[s][b];
+        }
+        printf("%-7s %7ld ", lat_name[s], n);
+        for(b = 0; b < LAT_BUCKETS; b++)
+        {
+            if(lat_hist[s][b])
+            {
+                printf(" %g:%u", (b ? 1 << b : 0) * 0.064, lat_hist[s][b]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int t1;
+    int s, b;
+    long n[LAT_STAGES] = {0};
+
+    if(argc > 1)
+    {
+        if(!trace_load(argv[1]))
+        {
+            printf("test_latency: cannot read %s\n", argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        for(t1 = 0; t1 < sizeof(trace_default) / sizeof(trace_default[0]); t1++)
+        {
+            trace_add(trace_default[t1][0], trace_default[t1][1]);
+        }
+    }
+
+    setup();
+    replay();
+    hw_run(0);
+    report();
+
+    //Every measurement that was started finished all stages
+    for(s = 0; s < LAT_STAGES; s++)
+    {
+        for(b = 0; b < LAT_BUCKETS; b++)
+        {
+            n[s] += lat_hist[s][b];
+        }
+    }
+    CHECK(!lat_pending);
+    CHECK(n[0] > 0 && n[0] <= trace_detents);
+    CHECK(n[1] == n[0] && n[2] == n[0]);
+    CHECK(twi_errors == 0 && ssd_unknown == 0);
+
+    return check_result("test_latency");
+}
@@ -0,0 +1,336 @@
+//Display: frame buffer, flush windows and drawing functions against the
+//SSD1306 model
+//Usage: test_oled [trace]
+//Meter trace file: one get_s_value() result per line (bar columns),
+//without a file the meter runs a synthetic random walk
+#include "fw.h"
+#include "check.h"
+#include "ssd1306.h"
+
+//Bus traffic of the last measure_flush()
+unsigned long flush_bytes, flush_trans;
+
+static void setup(void)
+{
+    uint8_t *p = ssd_ram[0];
+    int t1;
+    
+    hw_reset();
+    ssd_reset();
+    hw_attach(&ssd_dev);
+    twi_init();
+    twi_errors = 0;
+    hw_run(20);
+    
+    //Display RAM content is unknown after power on
+    for(t1 = 0; t1 < (int) sizeof(ssd_ram); t1++)
+    {
+        p[t1] = rand();
+    }
+    memset(oled_fb, 0, sizeof(oled_fb));
+    oled_init();
+    oled_flush();
+    twi_sync();
+}
+
+//Flush and count bus bytes/transactions, checks byte counter of firmware
+static void measure_flush(void)
+{
+    unsigned long bytes = oled_bytes;
+    
+    hw_twi_stats_reset();
+    oled_flush();
+    twi_sync();
+    flush_bytes = hw_twi_bytes;
+    flush_trans = hw_twi_trans;
+    CHECK(oled_bytes - bytes == flush_bytes);
+}
+
+//Whole screen changed: one window, 1024 bytes in chunks of OLEDCHUNK
+static void test_full_screen(void)
+{
+    int chunks = (1024 + OLEDCHUNK - 1) / OLEDCHUNK;
+    int row, col;
+    
+    setup();
+    CHECK(ssd_matches_fb());
+    
+    for(row = 0; row < S_LCDHEIGHT / 8; row++)
+    {
+        oled_gotoxy(0, row);
+        for(col = 0; col < S_LCDWIDTH; col++)
+        {
+            oled_byte(oled_fb[row][col] ^ (1 + rand() % 255));
+        }
+    }
+    measure_flush();
+    CHECK(ssd_matches_fb());
+    CHECK(flush_trans == 1 + chunks);
+    CHECK(flush_bytes == 8 + 1024 + 2 * chunks);
+    CHECK(twi_errors == 0 && ssd_unknown == 0);
+    printf("full screen: %lu transactions, %lu bytes\n", flush_trans, flush_bytes);
+}
+
+//Random bytes at random places, flushes and budgeted flushes in between
+//A budgeted flush never fills the queue beyond the room kept for the
+//Si5351 (it would wait in twi_put() otherwise); the queue drains at
+//random between the calls, so windows are cut at any width
+static void test_frame_buffer(void)
+{
+    int t1, t2, row, room;
+    
+    setup();
+    for(t1 = 0; t1 < 2000; t1++)
+    {
+        for(t2 = rand() % 20; t2 > 0; t2--)
+        {
+            oled_gotoxy(rand() % S_LCDWIDTH, rand() % (S_LCDHEIGHT / 8));
+            oled_byte((rand() & 3) ? rand() : 0);
+        }
+        if(rand() & 1)
+        {
+            oled_flush();
+        }
+        else
+        {
+            room = twi_room();
+            oled_flush_budget();
+            CHECK(twi_room() >= SI5351_QUEUE || twi_room() >= room);
+        }
+    }
+    oled_flush();
+    twi_sync();
+    CHECK(ssd_matches_fb());
+    CHECK(twi_errors == 0 && ssd_unknown == 0);
+    for(row = 0; row < S_LCDHEIGHT / 8; row++)
+    {
+        CHECK(oled_dx0[row] >= oled_dx1[row]);
+    }
+}
+
+//Writing what is already in the frame buffer sends nothing,
+//a clear and redraw sends only the pages it touched
+static void test_unchanged(void)
+{
+    setup();
+    oled_putstring(0, 0, "MICRO26", 0, 0);
+    oled_putstring(0, 4, "14.200.00", 1, 0);
+    measure_flush();
+    
+    oled_putstring(0, 0, "MICRO26", 0, 0);
+    oled_putstring(0, 4, "14.200.00", 1, 0);
+    measure_flush();
+    CHECK(flush_bytes == 0 && flush_trans == 0);
+    
+    oled_fill(0, S_LCDWIDTH, 4, 6, 0);
+    oled_putstring(0, 4, "14.200.00", 1, 0);
+    measure_flush();
+    CHECK(flush_trans == 2 && flush_bytes <= 8 + 2 + 2 * 9 * 2 * FONTW);
+    CHECK(ssd_matches_fb());
+}
+
+//Text run of oled_putstring() against glyphs copied from the font table
+static void test_text_run(void)
+{
+    char str[22];
+    uint8_t expect[S_LCDWIDTH];
+    int t1, t2, t3, n, x, row, inv;
+    
+    setup();
+    for(t1 = 0; t1 < 1000; t1++)
+    {
+        n = 1 + rand() % 21;
+        x = rand() % (S_LCDWIDTH - n * FONTW + 1);
+        row = rand() % (S_LCDHEIGHT / 8);
+        inv = rand() & 1;
+        for(t2 = 0; t2 < n; t2++)
+        {
+            str[t2] = 32 + rand() % (sizeof(font) / FONTW);
+            for(t3 = 0; t3 < FONTW; t3++)
+            {
+                expect[t2 * FONTW + t3] = font[str[t2] - 32][t3] ^ (inv ? 0xFF : 0);
+            }
+        }
+        str[n] = 0;
+        oled_putstring(x, row, str, 0, inv);
+        CHECK(!memcmp(&oled_fb[row][x], expect, n * FONTW));
+    }
+}
+
+//Menu item of 8 characters: one window and one data transaction
+static void test_menu_item(void)
+{
+    setup();
+    print_menu_item("VFO SWAP", 0, 1);
+    measure_flush();
+    CHECK(flush_trans == 2 && flush_bytes <= 10 + 8 * FONTW);
+    CHECK(ssd_matches_fb());
+    printf("menu item: %lu transactions, %lu bytes\n", flush_trans, flush_bytes);
+}
+
+//oled_putchar2() before the nibble table (bit loop), for comparison
+static void old_putchar2(unsigned int x, unsigned int y, unsigned char ch, int invert)
+{
+    int t0, t1;
+    char c;
+    int i[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    
+    for(t0 = 0; t0 < FONTW; t0++)
+    {
+        for(t1 = 0; t1 < 8; t1++)
+        {
+            if(!invert)
+            {
+                c = pgm_read_byte(&font[ch - 32][t0]);
+            }
+            else
+            {
+                c = ~pgm_read_byte(&font[ch - 32][t0]);
+            }
+            if(c & (1 << t1))
+            {
+                i[t0] += (1 << (t1 * 2));
+                i[t0] += (1 << (t1 * 2 + 1));
+            }
+        }
+    }
+    
+    oled_gotoxy(x, y);
+    for(t0 = 0; t0 < FONTW; t0++)
+    {
+        oled_byte(i[t0] & 0xFF);
+        oled_byte(i[t0] & 0xFF);
+    }
+    oled_gotoxy(x, y + 1);
+    for(t0 = 0; t0 < FONTW; t0++)
+    {
+        oled_byte((i[t0] & 0xFF00) >> 8);
+        oled_byte((i[t0] & 0xFF00) >> 8);
+    }
+}
+
+//Double height glyphs: every character, normal and inverted, bit for bit
+static void test_double_height(void)
+{
+    uint8_t expect[2][2 * FONTW];
+    int ch, inv, n = sizeof(font) / FONTW, t1;
+    double t0, t_old, t_new;
+    
+    setup();
+    for(inv = 0; inv < 2; inv++)
+    {
+        for(ch = 32; ch < 32 + n; ch++)
+        {
+            old_putchar2(0, 2, ch, inv);
+            memcpy(expect[0], &oled_fb[2][0], 2 * FONTW);
+            memcpy(expect[1], &oled_fb[3][0], 2 * FONTW);
+            oled_fill(0, 2 * FONTW, 2, 4, 0x5A);
+            oled_putchar2(0, 2, ch, inv);
+            CHECK(!memcmp(expect[0], &oled_fb[2][0], 2 * FONTW));
+            CHECK(!memcmp(expect[1], &oled_fb[3][0], 2 * FONTW));
+        }
+    }
+    
+    //Host timing, frame buffer writes included
+    t0 = check_ns();
+    for(t1 = 0; t1 < 2000; t1++)
+    {
+        for(ch = 32; ch < 32 + n; ch++)
+        {
+            old_putchar2(0, 2, ch, t1 & 1);
+        }
+    }
+    t_old = (check_ns() - t0) / (2000 * n);
+    t0 = check_ns();
+    for(t1 = 0; t1 < 2000; t1++)
+    {
+        for(ch = 32; ch < 32 + n; ch++)
+        {
+            oled_putchar2(0, 2, ch, t1 & 1);
+        }
+    }
+    t_new = (check_ns() - t0) / (2000 * n);
+    printf("oled_putchar2: bit loop %.1f ns, nibble table %.1f ns (host)\n", t_old, t_new);
+}
+
+//S-meter page after incremental updates against the expected bar:
+//columns 0...sv-1 and the peak marker behind the bar set, rest clear
+//Values from 'trace' if given, else a slowly moving signal with jumps;
+//now and then the screen is cleared like by the scan screens
+static void test_meter(FILE *trace)
+{
+    int t1, x, sv = 0, bar, peak, ok = 1;
+    unsigned long bytes = 0;
+    uint8_t expect;
+    
+    setup();
+    oled_cls(0);
+    for(t1 = 0; trace || t1 < 20000; t1++)
+    {
+        if(trace)
+        {
+            if(fscanf(trace, "%d", &sv) != 1)
+            {
+                break;
+            }
+        }
+        else if(rand() % 50)
+        {
+            sv += rand() % 7 - 3; //Slowly moving signal
+        }
+        else
+        {
+            sv = rand() % 140 - 10;
+        }
+        if(!trace && (sv < -10 || sv > 130))
+        {
+            sv = 60;
+        }
+        peak_val = (rand() % 4) ? peak_val : (unsigned int) (rand() % 121) << 8;
+        if(!(rand() % 200))
+        {
+            oled_cls(0);
+        }
+        
+        show_meter(sv);
+        peak = (peak_val >> 8) - 1;
+        bar = sv < 0 ? 0 : (sv > 120 ? 120 : sv);
+        for(x = 0; x < S_LCDWIDTH; x++)
+        {
+            expect = (x < bar || (x == peak && peak >= bar)) ? 0x1E : 0;
+            ok &= oled_fb[6][x] == expect;
+        }
+        measure_flush();
+        bytes += flush_bytes;
+    }
+    CHECK(ok);
+    CHECK(ssd_matches_fb());
+    printf("meter: %.1f bytes per update over %d %s values (full redraw of page: %d)\n",
+           t1 ? (double) bytes / t1 : 0.0, t1, trace ? "recorded" : "synthetic", 10 + S_LCDWIDTH);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *trace = 0;
+    
+    if(argc > 1 && !(trace = fopen(argv[1], "r")))
+    {
+        printf("test_oled: cannot read %s\n", argv[1]);
+        return 1;
+    }
+    srand(8);
+    test_full_screen();
+    test_frame_buffer();
+    test_unchanged();
+    test_text_run();
+    test_menu_item();
+    test_double_height();
+    test_meter(trace);
+    if(trace)
+    {
+        fclose(trace);
+    }
+    hw_run(0);
+    
+    return check_result("test_oled");
+}
@@ -0,0 +1,210 @@
+//Latest-wins retuning: the tuning part of the main loop with Si5351 and
+//SSD1306 on the bus while the encoder spins at fixed speeds. Measures
+//the lag from a change of the target frequency until the Si5351 and the
+//display show the newest target. Every transaction to the display
+//leaves both halves of the frequency digits (pages 4 and 5) from the
+//same frame.
+#include "fw.h"
+#include "check.h"
+#include "si5351.h"
+#include "ssd1306.h"
+
+//Gray code in turning direction, pins PD6:PD5
+static const uint8_t gray[4] = {0, 1, 3, 2};
+
+//Encoder spins from spin_t0 for spin_ns at one detent per detent_ns
+uint64_t spin_t0, spin_ns, detent_ns;
+
+static uint8_t spin_pins(uint64_t ns)
+{
+    uint64_t t = ns - spin_t0;
+
+    if(t > spin_ns)
+    {
+        t = spin_ns;
+    }
+    return gray[(t * ENC_DETENT / detent_ns) & 3] << 5;
+}
+
+static uint64_t now(void)
+{
+    return *(volatile uint64_t *) &hw_ns;
+}
+
+//Target changes are numbered, t_gen[] holds the time of each.
+//A consumer shows change 'done', its lag is the age of the oldest
+//change it has not caught up with.
+#define GENS 100000
+uint64_t t_gen[GENS];
+long gen;
+
+typedef struct
+{
+    long sent, pend, done;  //Change sent, in queue up to 'ticket', on the bus
+    uint16_t ticket;
+    uint64_t max;
+} lag;
+
+static void lag_update(lag *l)
+{
+    uint64_t t;
+
+    if(l->pend > l->done && twi_passed(l->ticket))
+    {
+        l->done = l->pend;
+    }
+    if(l->done < gen)
+    {
+        t = now() - t_gen[l->done + 1];
+        l->max = t > l->max ? t : l->max;
+    }
+}
+
+//Column pairs of pages 4 and 5 ever rendered, per column
+uint8_t halves_seen[S_LCDWIDTH][256][32];
+long halves_stops = 0, halves_bad = 0;
+
+static void halves_mark(void)
+{
+    int x;
+
+    for(x = 0; x < S_LCDWIDTH; x++)
+    {
+        halves_seen[x][oled_fb[4][x]][oled_fb[5][x] >> 3] |= 1 << (oled_fb[5][x] & 7);
+    }
+}
+
+//STOP to the display: every column shows halves rendered together
+static void halves_check(void)
+{
+    int x;
+
+    for(x = 0; x < S_LCDWIDTH; x++)
+    {
+        if(!(halves_seen[x][ssd_ram[4][x]][ssd_ram[5][x] >> 3] & (1 << (ssd_ram[5][x] & 7))))
+        {
+            halves_bad++;
+            break;
+        }
+    }
+    halves_stops++;
+}
+
+static void setup(void)
+{
+    hw_reset();
+    ssd_reset();
+    syn_reset();
+    hw_attach(&ssd_dev);
+    hw_attach(&syn_dev);
+    twi_init();
+    hw_run(20);
+
+    hw_pins(gray[0] << 5);
+    PCMSK2 |= ((1<<PCINT21) | (1<<PCINT22));
+    PCICR |= (1<<PCIE2);
+    laststate = (PIND & 0x60) >> 5;
+    TCCR1B = (1 << CS10) | (1 << CS12) | (1<<WGM12);
+    TIMSK1 |= (1<<OCIE1A);
+
+    si5351_start();
+    oled_init();
+    oled_cls(0);
+    cur_vfo = 0;
+    f_vfo[0] = 14200000;
+    set_vfo_frequency(f_vfo[0] + INTERFREQUENCY);
+    show_frequency(f_vfo[0], 1);
+    draw_meter_scale(0);
+    oled_flush();
+    twi_sync();
+    halves_mark();
+    ssd_dev.stop = halves_check;
+}
+
+//Spin for 'ms' at 'ms_detent', then let the loop settle
+static void spin(double ms_detent, double ms)
+{
+    lag rf, disp;
+    long detents = 0;
+    unsigned int writes = si5351_transactions;
+    uint64_t end, t;
+    unsigned int trans;
+    long f_bcd;
+    int knob;
+
+    gen = 0;
+    t_gen[0] = now();
+    memset(&rf, 0, sizeof(rf));
+    memset(&disp, 0, sizeof(disp));
+    detent_ns = ms_detent * 1e6;
+    spin_ns = ms * 1e6;
+    spin_t0 = now();
+    end = spin_t0 + spin_ns + 100000000ULL;
+    hw_pind_input = spin_pins;
+
+    while(now() < end)
+    {
+        //Tuning part of the main loop, with a busy meter; new target,
+        //retune and render are seen from the state it leaves
+        f_bcd = freq_bcd_f;
+        trans = si5351_transactions;
+        t = now();
+        knob = tune_vfo(0);
+        if(knob)
+        {
+            detents += abs(knob);
+            t_gen[++gen] = t;
+        }
+        if(si5351_transactions != trans)
+        {
+            rf.pend = gen;
+            rf.ticket = si5351_ticket;
+        }
+        if(freq_bcd_f != f_bcd)
+        {
+            halves_mark();
+            disp.sent = gen;
+        }
+        show_meter((detents + (now() >> 20)) % 121);
+        oled_flush_budget();
+        if(disp.sent > disp.pend && disp.pend == disp.done
+           && oled_dx0[4] >= oled_dx1[4] && oled_dx0[5] >= oled_dx1[5])
+        {
+            disp.pend = disp.sent;
+            disp.ticket = oled_ticket;
+        }
+        lag_update(&rf);
+        lag_update(&disp);
+    }
+    hw_pind_input = 0;
+    writes = si5351_transactions - writes;
+
+    CHECK(rf.done == gen && disp.done == gen);
+    CHECK(fabsl(syn_fout(1) - (f_vfo[cur_vfo] + INTERFREQUENCY)) < 1);
+    //Si5351 waits for at most a full queue and its own write
+    CHECK(rf.max < (TWI_BUFSIZE + 2 * OLEDCHUNK + 20) * HW_BYTE_NS + 1000000);
+    //Display a few passes behind at most, well below what the eye notices
+    CHECK(disp.max < 50000000ULL);
+    printf("%9.1f %8ld %7ld %7u %10.2f %11.2f\n", ms_detent, detents, gen, writes,
+           rf.max / 1e6, disp.max / 1e6);
+}
+
+int main(void)
+{
+    static const double speed[] = {100, 20, 5, 2, 1, 0.5};
+    unsigned int t1;
+
+    setup();
+    printf("ms/detent  detents  targets  writes  RF lag/ms  OLED lag/ms\n");
+    for(t1 = 0; t1 < sizeof(speed) / sizeof(speed[0]); t1++)
+    {
+        spin(speed[t1], 500);
+    }
+    CHECK(twi_errors == 0 && ssd_unknown == 0);
+    hw_run(0);
+    CHECK(halves_stops > 0 && !halves_bad);
+    printf("retune: %ld display transactions, %ld with mixed frequency halves\n",
+           halves_stops, halves_bad);
+
+    return check_result("test_retune");
+}
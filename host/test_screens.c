@@ -0,0 +1,213 @@
+//Display screens rendered by the SSD1306 model
+//Draws the main UI elements one after another like in a session, writes
+//each screen as 128 x 64 PBM and compares it with the golden image in
+//screens/. Reports transactions, bytes and bus time at 400 kHz per
+//screen (Si5351 traffic of the memory preview included). Screens that
+//used to start with oled_cls() on the bus (menu pages, memory select)
+//also report the full redraw of the same screen as baseline (a lower
+//bound: the old path also sent the cleared pages before the text).
+//Usage: test_screens [-u]   -u: write new golden images
+#include "fw.h"
+#include "check.h"
+#include "si5351.h"
+#include "ssd1306.h"
+
+#define KEY_NONE 1023
+#define KEY_1 88
+
+uint64_t key_at = ~0ULL; //Simulated time of key press
+
+//Keys on ADC0, S-meter and the others at half scale
+static int adc_input(int channel)
+{
+    if(channel == 0)
+    {
+        return hw_ns >= key_at ? KEY_1 : KEY_NONE;
+    }
+    return 512;
+}
+
+static void scr_init(void)
+{
+    oled_init();
+    oled_cls(0);
+}
+
+static void scr_frequency(void)
+{
+    show_frequency(14200000, 1);
+}
+
+static void scr_frequency_step(void)
+{
+    show_frequency(14200010, 0);
+}
+
+static void scr_frequency_carry(void)
+{
+    show_frequency(14199990, 0);
+}
+
+static void scr_scale_s(void)
+{
+    draw_meter_scale(0);
+}
+
+static void scr_scale_pwr(void)
+{
+    draw_meter_scale(1);
+}
+
+static void scr_menu(void)
+{
+    print_menu_head("VFO/MEM", 4);
+    print_menu_item_list(0, -1, 0);
+    print_menu_item_list(0, 0, 1);
+}
+
+static void scr_menu_next(void)
+{
+    print_menu_item_list(0, 0, 0);
+    print_menu_item_list(0, 1, 1);
+}
+
+static void scr_mem_select(void)
+{
+    key_at = hw_ns + 20000000ULL; //Leave with key 1 after 20 ms
+    mem_select(5, 1);
+    key_at = ~0ULL;
+    oled_flush();
+}
+
+typedef struct
+{
+    const char *name;
+    void (*draw)(void);
+    int full; //Baseline: whole screen sent
+} screen;
+
+const screen screens[] = {{"init", scr_init, 0},
+                          {"frequency", scr_frequency, 0},
+                          {"frequency_step", scr_frequency_step, 0},
+                          {"frequency_carry", scr_frequency_carry, 0},
+                          {"scale_s", scr_scale_s, 0},
+                          {"scale_pwr", scr_scale_pwr, 0},
+                          {"menu", scr_menu, 1},
+                          {"menu_next", scr_menu_next, 1},
+                          {"mem_select", scr_mem_select, 1}};
+
+//Send the whole frame buffer again like a redraw after clearing the
+//display over the bus, same content; returns bytes, prints the cost
+static unsigned long full_redraw(void)
+{
+    int row;
+    
+    for(row = 0; row < S_LCDHEIGHT / 8; row++)
+    {
+        oled_dx0[row] = 0;
+        oled_dx1[row] = S_LCDWIDTH;
+    }
+    hw_twi_stats_reset();
+    oled_flush();
+    twi_sync();
+    printf("  full redraw    %6lu %6lu %7.1f\n", hw_twi_trans, hw_twi_bytes, hw_twi_ns / 1000.0);
+    
+    return hw_twi_bytes;
+}
+
+//Compare display RAM with PBM file, returns 1 if equal
+static int compare_pbm(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    int x = 0, y = 0, c, w, h, same = 1;
+    
+    if(!f)
+    {
+        return 0;
+    }
+    if(fscanf(f, "P1 %d %d", &w, &h) != 2 || w != 128 || h != 64)
+    {
+        fclose(f);
+        return 0;
+    }
+    while(y < 64 && (c = fgetc(f)) != EOF)
+    {
+        if(c != '0' && c != '1')
+        {
+            continue;
+        }
+        same &= (c - '0') == ssd_pixel(x, y);
+        if(++x == 128)
+        {
+            x = 0;
+            y++;
+        }
+    }
+    fclose(f);
+    
+    return same && y == 64;
+}
+
+int main(int argc, char **argv)
+{
+    int update = argc > 1 && !strcmp(argv[1], "-u");
+    unsigned int t1;
+    char path[64];
+    const char *res;
+    unsigned long bytes;
+    
+    hw_reset();
+    ssd_reset();
+    syn_reset();
+    hw_attach(&ssd_dev);
+    hw_attach(&syn_dev);
+    hw_adc_input = adc_input;
+    twi_init();
+    hw_run(20);
+    si5351_start();
+    adc_init();
+    for(t1 = 0; t1 < 16; t1++)
+    {
+        store_frequency(14000000 + t1 * 25000, 0, t1);
+    }
+    twi_sync();
+    
+    printf("screen            trans  bytes  bus/us  image\n");
+    for(t1 = 0; t1 < sizeof(screens) / sizeof(screens[0]); t1++)
+    {
+        hw_twi_stats_reset();
+        screens[t1].draw();
+        oled_flush();
+        twi_sync();
+        
+        sprintf(path, "screens/%s.pbm", screens[t1].name);
+        if(update)
+        {
+            res = ssd_write_pbm(path) ? "written" : "write error";
+        }
+        else if(compare_pbm(path))
+        {
+            res = "ok";
+        }
+        else
+        {
+            sprintf(path, "screens/%s.fail.pbm", screens[t1].name);
+            ssd_write_pbm(path);
+            res = "DIFFERS";
+            check_failed++;
+        }
+        printf("%-16s %6lu %6lu %7.1f  %s\n", screens[t1].name, hw_twi_trans, hw_twi_bytes,
+               hw_twi_ns / 1000.0, res);
+        CHECK(ssd_matches_fb());
+        if(screens[t1].full)
+        {
+            bytes = hw_twi_bytes;
+            CHECK(full_redraw() > bytes);
+            CHECK(ssd_matches_fb());
+        }
+    }
+    CHECK(twi_errors == 0 && ssd_unknown == 0);
+    hw_run(0);
+    
+    return check_result("test_screens");
+}
@@ -0,0 +1,111 @@
+//Si5351 divider a + b/c against an exact reference
+//23.0...23.4 MHz (VFO for 14.0...14.4 MHz at 9 MHz IF) in 1 Hz steps
+//plus the LO frequencies of both IF options
+#include "fw.h"
+#include "check.h"
+
+#define FVCO ((uint64_t) F_XTAL * PLLRATIO)
+
+//Exact nearest a * c + b = round(fvco * c / f)
+static uint64_t ref_div(uint32_t f)
+{
+    return (FVCO * CFACTOR + f / 2) / f;
+}
+
+//Output frequency for a + b/c
+static long double fout(uint32_t a, uint32_t b)
+{
+    return (long double) FVCO * CFACTOR / ((long double) a * CFACTOR + b);
+}
+
+//Full calculation: multisynth state unknown as after si5351_invalidate()
+static void calc_div(uint32_t f, unsigned int *a, unsigned int *b)
+{
+    si5351_ms_f[2] = 0;
+    si5351_calc_div_step(2, f, a, b);
+}
+
+//Baseline: division in double (32 bit float on the AVR), b truncated
+static void float_div(uint32_t f, uint32_t *a, uint32_t *b)
+{
+    float x = (float) FVCO / f;
+    
+    *a = (uint32_t) x;
+    *b = (uint32_t) ((x - *a) * CFACTOR);
+}
+
+static double worst = 0, worst_f = 0, worst_float = 0;
+volatile unsigned int sink; //Keeps timed results alive
+
+static void check_freq(uint32_t f)
+{
+    unsigned int a, b, p1, p2;
+    uint64_t x = ref_div(f);
+    double err;
+    
+    calc_div(f, &a, &b);
+    CHECK((uint64_t) a * CFACTOR + b == x);
+    CHECK(b < CFACTOR);
+    
+    //P1/P2 encode the same ratio: (P1 + 512) * c + P2 = 128 * (a * c + b)
+    si5351_calc_p(a, b, &p1, &p2);
+    CHECK((uint64_t) (p1 + 512) * CFACTOR + p2 == 128 * ((uint64_t) a * CFACTOR + b));
+    CHECK(p2 < CFACTOR);
+    
+    err = fabsl(fout(a, b) - f);
+    if(err > worst)
+    {
+        worst = err;
+        worst_f = f;
+    }
+    
+    float_div(f, &a, &b);
+    err = fabsl(fout(a, b) - f);
+    if(err > worst_float)
+    {
+        worst_float = err;
+    }
+}
+
+int main(void)
+{
+    static const uint32_t lo[] = {F_LO_LSB, F_LO_USB, 8998600, 9001700, 10691050, 10697770};
+    unsigned int a, b, p1, p2;
+    uint32_t f, n = 0;
+    double t0, t_int, t_float;
+    unsigned int t1;
+    
+    for(f = 23000000; f <= 23400000; f++, n++)
+    {
+        check_freq(f);
+    }
+    for(t1 = 0; t1 < sizeof(lo) / sizeof(lo[0]); t1++, n++)
+    {
+        check_freq(lo[t1]);
+    }
+    printf("%u frequencies, worst error %.4f Hz at %.0f Hz (float baseline %.1f Hz)\n",
+           n, worst, worst_f, worst_float);
+    CHECK(worst < 0.3);
+    
+    //Host timing incl. P1/P2, only the ratio says something about the AVR
+    t0 = check_ns();
+    for(f = 23000000; f <= 23400000; f++)
+    {
+        calc_div(f, &a, &b);
+        si5351_calc_p(a, b, &p1, &p2);
+        sink = p1 + p2;
+    }
+    t_int = (check_ns() - t0) / 400001;
+    t0 = check_ns();
+    for(f = 23000000; f <= 23400000; f++)
+    {
+        float_div(f, &a, &b);
+        p1 = 128 * a + (128 * b / CFACTOR) - 512;
+        p2 = 128 * b - CFACTOR * (128 * b / CFACTOR);
+        sink = p1 + p2;
+    }
+    t_float = (check_ns() - t0) / 400001;
+    printf("integer %.1f ns/call, float baseline %.1f ns/call (host)\n", t_int, t_float);
+    
+    return check_result("test_si5351_div");
+}
@@ -0,0 +1,109 @@
+//Frequency plan SYNTHOPTION 1 (built with -DSYNTHOPTION=1)
+//Even integer multisynth, VCO range, accuracy and bytes per step,
+//decoded from the Si5351 register model
+#include "fw.h"
+#include "check.h"
+#include "si5351.h"
+
+#if (SYNTHOPTION != 1)
+#error "Build with -DSYNTHOPTION=1"
+#endif
+
+//Multisynth must be an even integer divider
+static void check_ms_int(int ms)
+{
+    uint32_t p1, p2, p3;
+    
+    syn_params(SYNTH_MS_0 + 8 * ms, &p1, &p2, &p3);
+    CHECK(syn_reg[CLK0_CONTROL + ms] & 0x40);
+    CHECK(p2 == 0 && p3 == 1);
+    CHECK((p1 + 512) % 256 == 0);
+}
+
+static void check_vco(int ms)
+{
+    long double fvco = syn_fvco(ms);
+    
+    CHECK(fvco >= SI5351_VCO_MIN && fvco <= SI5351_VCO_MAX);
+}
+
+int main(void)
+{
+    unsigned long ms1_writes, steps = 0;
+    long f;
+    double err, worst = 0;
+    
+    hw_reset();
+    syn_reset();
+    hw_attach(&syn_dev);
+    twi_init();
+    hw_run(20);
+    
+    si5351_start();
+    twi_sync();
+    CHECK(syn_writes[PLL_RESET] == 2); //Power up and first plan
+    set_lo_frequency(F_LO_USB);
+    set_vfo_frequency(14000000 + INTERFREQUENCY);
+    twi_sync();
+    check_ms_int(0);
+    check_ms_int(1);
+    check_vco(0);
+    check_vco(1);
+    CHECK(fabsl(syn_fout(0) - F_LO_USB) < 0.5);
+    
+    //Tune the 20m band: only PLL B may change, divider of MS1 stays
+    ms1_writes = syn_writes[SYNTH_MS_1 + 4];
+    hw_twi_stats_reset();
+    for(f = 13999000; f <= 14400000; f += 10, steps++)
+    {
+        set_vfo_frequency(f + INTERFREQUENCY);
+        twi_sync();
+        check_vco(1);
+        err = fabsl(syn_fout(1) - (f + INTERFREQUENCY));
+        if(err > worst)
+        {
+            worst = err;
+        }
+    }
+    CHECK(syn_writes[SYNTH_MS_1 + 4] == ms1_writes);
+    CHECK(worst < 0.5);
+    printf("VFO worst error %.3f Hz, %.2f bytes and %.2f transactions per 10 Hz step\n",
+           worst, (double) hw_twi_bytes / steps, (double) hw_twi_trans / steps);
+    
+    //LO in range of both sidebands, then out of the planned range: new divider and PLL reset
+    set_lo_frequency(F_LO_LSB);
+    twi_sync();
+    CHECK(fabsl(syn_fout(0) - F_LO_LSB) < 0.5);
+    CHECK(syn_writes[PLL_RESET] == 2);
+    set_lo_frequency(9500000);
+    twi_sync();
+    CHECK(syn_writes[PLL_RESET] == 3);
+    check_ms_int(0);
+    check_vco(0);
+    CHECK(fabsl(syn_fout(0) - 9500000) < 0.5);
+    
+    //No even divider below 334 kHz or above 150 MHz: nothing is written,
+    //the output stays at the last frequency
+    hw_twi_stats_reset();
+    set_lo_frequency(200000);
+    set_lo_frequency(160000000);
+    twi_sync();
+    CHECK(hw_twi_trans == 0);
+    CHECK(si5351_ms_n[0] != 0);
+    check_ms_int(0);
+    check_vco(0);
+    CHECK(fabsl(syn_fout(0) - 9500000) < 0.5);
+    
+    //Jump from a large divider to a high frequency (n * f beyond 32 bit)
+    set_lo_frequency(400000);
+    twi_sync();
+    CHECK(fabsl(syn_fout(0) - 400000) < 0.5);
+    set_lo_frequency(30000000);
+    twi_sync();
+    check_ms_int(0);
+    check_vco(0);
+    CHECK(fabsl(syn_fout(0) - 30000000) < 0.5);
+    hw_run(0);
+    
+    return check_result("test_si5351_plan");
+}
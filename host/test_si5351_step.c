@@ -0,0 +1,136 @@
+//Incremental divider si5351_calc_div_step() against the full calculation
+//Random tuning sequences over 23.0...23.4 MHz and timing per step
+//for the step sizes of the acceleration curve. The host divides in
+//hardware, so the host timing does not show the gain; the AVR cost is
+//estimated from the operations (not measured, no simulator here):
+//libgcc's __udivmodsi4 is a shift and subtract loop of 32 steps at about
+//20 cycles, a 32 bit multiply about 40 cycles, si5351_calc_b() 20 steps
+//of about 20 cycles. The incremental path replaces fvco / f and a * f
+//by a * d whenever a stays the same.
+#include "fw.h"
+#include "check.h"
+
+#define FMIN 23000000
+#define FMAX 23400000
+
+#define AVR_DIV_CYCLES (32 * 20)
+#define AVR_MUL_CYCLES 40
+#define AVR_CALC_B_CYCLES (20 * 20)
+#define AVR_FULL_CYCLES (AVR_DIV_CYCLES + AVR_MUL_CYCLES + AVR_CALC_B_CYCLES)
+#define AVR_STEP_CYCLES (AVR_MUL_CYCLES + AVR_CALC_B_CYCLES)
+
+//Full calculation in multisynth slot 2
+static void calc_div(uint32_t f, unsigned int *a, unsigned int *b)
+{
+    si5351_ms_f[2] = 0;
+    si5351_calc_div_step(2, f, a, b);
+}
+
+//Random step: mostly encoder steps, sometimes a jump (band edge, memory)
+static int32_t random_step(void)
+{
+    static const int32_t size[] = {1, 10, 20, 50, 100, 500, 2500, 99999, 100000, 250000};
+    int32_t d = size[rand() % 10];
+    
+    if(rand() & 1)
+    {
+        d = rand() % d + 1;
+    }
+    return (rand() & 1) ? d : -d;
+}
+
+static void test_random_steps(void)
+{
+    unsigned int a0, b0, a1, b1;
+    uint32_t f = FMIN + 200000;
+    int32_t d;
+    long n;
+    
+    si5351_invalidate();
+    for(n = 0; n < 2000000; n++)
+    {
+        d = random_step();
+        if(f + d < FMIN || f + d > FMAX)
+        {
+            d = -d;
+        }
+        f += d;
+        si5351_calc_div_step(1, f, &a0, &b0);
+        calc_div(f, &a1, &b1);
+        if(a0 != a1 || b0 != b1)
+        {
+            printf("f %u d %d: %u + %u/c, expected %u + %u/c\n", f, d, a0, b0, a1, b1);
+            CHECK(0);
+            return;
+        }
+    }
+}
+
+volatile unsigned int sink; //Keeps timed results alive
+
+//ns per call for a run of steps of size d, calls that needed the full
+//division in *full
+static double time_steps(int32_t d, int incremental, long *full)
+{
+    unsigned int a, b, a_old = 0;
+    uint32_t f_old;
+    uint32_t f = FMIN;
+    double t0 = check_ns();
+    long n;
+    
+    si5351_invalidate();
+    *full = 0;
+    for(n = 0; n < 1000000; n++)
+    {
+        f += d;
+        if(f > FMAX)
+        {
+            f = FMIN;
+        }
+        if(incremental)
+        {
+            f_old = si5351_ms_f[1];
+            si5351_calc_div_step(1, f, &a, &b);
+            if(!f_old || llabs((int64_t) f - f_old) >= SI5351_MAXSTEP || a != a_old)
+            {
+                (*full)++;
+            }
+            a_old = a;
+        }
+        else
+        {
+            calc_div(f, &a, &b);
+        }
+        sink = a + b;
+    }
+    
+    return (check_ns() - t0) / 1000000;
+}
+
+int main(void)
+{
+    static const int32_t step[] = {10, 20, 50, 100, 500, 2500, 100000};
+    unsigned int t1;
+    double t_inc, t_full, avr;
+    long full;
+    
+    srand(5);
+    test_random_steps();
+    
+    printf("step/Hz  incremental  full (ns/call, host)  divisions  AVR estimate (cycles)\n");
+    for(t1 = 0; t1 < sizeof(step) / sizeof(step[0]); t1++)
+    {
+        t_full = time_steps(step[t1], 0, &full);
+        t_inc = time_steps(step[t1], 1, &full);
+        avr = AVR_STEP_CYCLES + full / 1e6 * AVR_DIV_CYCLES;
+        printf("%7d  %11.1f  %4.1f  %19.4f%%  %5.0f vs %d\n", step[t1], t_inc, t_full,
+               full / 1e4, avr, AVR_FULL_CYCLES);
+        //Encoder steps: a changes only every few kHz, the division is skipped
+        if(step[t1] <= 2500)
+        {
+            CHECK(avr < AVR_FULL_CYCLES * 0.6);
+        }
+    }
+    
+    return check_result("test_si5351_step");
+}
@@ -0,0 +1,208 @@
+//TWI queue: producer stalls, resume after stall, NACK counting and
+//random traffic with interrupts from a seeded schedule
+#include "fw.h"
+#include "check.h"
+
+//Slave that records every transaction as [addr][length][data]
+#define LOG_SIZE 65536
+uint8_t log_buf[LOG_SIZE];
+int log_len = 0, log_start = 0;
+int nack_at = -1; //Byte index in log_buf answered with NACK
+
+static void rec_start(void);
+static int rec_write(uint8_t b);
+
+hw_dev dev_a = {0x20, rec_start, rec_write, 0};
+hw_dev dev_b = {0x40, rec_start, rec_write, 0};
+
+static void rec_start(void)
+{
+    log_buf[log_len] = hw_dev_cur->addr;
+    log_buf[log_len + 1] = 0;
+    log_start = log_len + 1;
+    log_len += 2;
+}
+
+static int rec_write(uint8_t b)
+{
+    log_buf[log_start]++;
+    log_buf[log_len] = b;
+    return log_len++ != nack_at;
+}
+
+static void setup(void)
+{
+    hw_reset();
+    twi_init();
+    twi_done = 0;
+    twi_queued = 0;
+    twi_errors = 0;
+    log_len = 0;
+    nack_at = -1;
+}
+
+//Next transaction opened while previous one completes: ISR chains START
+//after the length byte and stalls before the address is queued
+static void test_stall_after_start(void)
+{
+    static const uint8_t expect[] = {0x20, 1, 0xAA, 0x40, 2, 0x01, 0x02};
+    
+    setup();
+    twi_begin(0x20, 1);
+    twi_put(0xAA);
+    twi_put(2);     //First half of twi_begin(0x40, 2) ...
+    hw_poll();      //... START of next transaction, stall for address
+    CHECK(twi_state == TWI_STALLED);
+    CHECK(TW_STATUS == TW_START);
+    twi_put(0x40);  //Second half
+    twi_queued++;
+    hw_poll();
+    twi_put(0x01);
+    hw_poll();
+    twi_put(0x02);
+    hw_poll();
+    
+    CHECK(twi_state == TWI_IDLE);
+    CHECK(twi_done == 2);
+    CHECK(twi_errors == 0);
+    CHECK(log_len == sizeof(expect) && !memcmp(log_buf, expect, sizeof(expect)));
+}
+
+//Stall right after a NACKed byte must not count the NACK twice
+static void test_stall_after_nack(void)
+{
+    setup();
+    nack_at = 2; //First data byte
+    twi_begin(0x20, 2);
+    twi_put(0x55);
+    hw_poll();
+    CHECK(twi_state == TWI_STALLED);
+    CHECK(TW_STATUS == TW_MT_DATA_NACK);
+    twi_put(0x66);
+    hw_poll();
+    
+    CHECK(twi_state == TWI_IDLE);
+    CHECK(twi_errors == 1);
+    CHECK(log_len == 4 && log_buf[1] == 2 && log_buf[3] == 0x66);
+}
+
+//Missing slave: every byte of the transaction is NACKed once
+static void test_missing_slave(void)
+{
+    uint16_t ticket;
+    
+    setup();
+    ticket = twi_begin(0x60, 3);
+    twi_put(1);
+    twi_put(2);
+    hw_poll();
+    twi_put(3);
+    hw_poll();
+    
+    CHECK(twi_passed(ticket));
+    CHECK(twi_errors == 4);
+    CHECK(log_len == 0);
+}
+
+//Longest transaction, several times the queue size, arrives in one
+//piece; twi_passed() leaves the I flag as it was
+static void test_max_len(void)
+{
+    uint16_t ticket;
+    int t1;
+    
+    setup();
+    ticket = twi_begin(0x20, TWI_MAXLEN);
+    for(t1 = 0; t1 < TWI_MAXLEN; t1++)
+    {
+        twi_put(t1);
+        if(!(t1 % 32))
+        {
+            hw_poll();
+        }
+    }
+    cli();
+    CHECK(!twi_passed(ticket));
+    CHECK(!(SREG & 0x80));
+    sei();
+    hw_poll();
+    
+    CHECK(twi_passed(ticket));
+    CHECK(twi_state == TWI_IDLE);
+    CHECK(twi_errors == 0);
+    CHECK(log_len == TWI_MAXLEN + 2 && log_buf[0] == 0x20 && log_buf[1] == TWI_MAXLEN);
+    for(t1 = 0; t1 < TWI_MAXLEN; t1++)
+    {
+        CHECK(log_buf[t1 + 2] == t1);
+    }
+}
+
+//Producer side of the random traffic: before every byte the bus and
+//ISR run a random number of events from the seeded schedule, or until
+//the queue has room. Small numbers let the producer run ahead, large
+//ones stall the ISR in the middle of a transaction.
+long stalls = 0;
+
+static void schedule(int bytes)
+{
+    hw_poll_max((rand() & 7) ? rand() % 4 : rand() % 40);
+    if(twi_state == TWI_STALLED)
+    {
+        stalls++;
+    }
+    while(twi_room() < bytes)
+    {
+        hw_poll_max(1);
+    }
+}
+
+//Random transactions with interrupts from a seeded schedule
+//(same run every time); every byte must arrive in order
+static void test_random_traffic(void)
+{
+    static uint8_t expect[LOG_SIZE];
+    int n = 0, t1, len;
+    uint8_t addr;
+    uint16_t ticket = 0;
+    
+    setup();
+    srand(1);
+    while(n < LOG_SIZE - 300)
+    {
+        len = rand() % 80;
+        addr = (rand() & 1) ? 0x20 : 0x40;
+        expect[n++] = addr;
+        expect[n++] = len;
+        schedule(2);
+        ticket = twi_begin(addr, len);
+        for(t1 = 0; t1 < len; t1++)
+        {
+            expect[n] = rand();
+            schedule(1);
+            twi_put(expect[n++]);
+        }
+    }
+    hw_poll();
+    
+    CHECK(twi_passed(ticket));
+    CHECK(twi_state == TWI_IDLE);
+    CHECK(twi_errors == 0);
+    CHECK(twi_done == twi_queued);
+    CHECK(log_len == n && !memcmp(log_buf, expect, n));
+    CHECK(stalls > 0);
+    printf("twi: %d bytes in %u transactions, ISR stalled %ld times\n", n, twi_queued, stalls);
+}
+
+int main(void)
+{
+    hw_attach(&dev_a);
+    hw_attach(&dev_b);
+    
+    test_stall_after_start();
+    test_stall_after_nack();
+    test_missing_slave();
+    test_max_len();
+    test_random_traffic();
+    
+    return check_result("test_twi");
+}
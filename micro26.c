@@ -42,6 +42,10 @@
 //12 Scan threshold
 //16:272: 16 MEM frequencies for 16 VFOs
 
+#ifndef F_CPU
+#define F_CPU 16000000UL //Before util/delay.h, delays are computed from it
+#endif
+
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -66,21 +70,62 @@ int cur_vfo = 0;
 int sideband = 0;  //0=USB, 1=LSB
 
 //Tuning
-int tuningcount = 0;
-int tuningknob = 0;
-int laststate = 0; //Last state of rotary encoder
+#define TIMER1_TOP 1562  //Timer 1 compare value, 1/10 s at 15625 ticks/s
+#define ENC_DETENT 4     //Encoder transitions per detent
+#define ENC_DT_MAX (TIMER1_TOP + 1) //Slowest interval tracked (ticks)
+volatile int tuningknob = 0;    //Encoder steps, read with encoder_take()
+volatile uint8_t laststate = 0; //Last Gray code of rotary encoder (PD6:PD5)
+volatile uint16_t enc_dt = ENC_DT_MAX; //Smoothed interval between transitions (ticks)
+uint16_t enc_time = 0;          //Timestamp of last transition (ticks)
+int8_t enc_dir = 0;             //Direction of last transition
+
+//Acceleration curve: {min. smoothed interval (ticks of 64us), Hz per detent}
+//First entry whose interval is reached applies, last entry must be 0
+const uint16_t enc_curve[][2] PROGMEM = {{781, 10},  //>= 50ms
+                                         {390, 20},  //>= 25ms
+                                         {187, 50},  //>= 12ms
+                                         {94, 100},  //>= 6ms
+                                         {47, 500},  //>= 3ms
+                                         {0, 2500}};
+
+//Quadrature decoder, index = (last AB << 2) | new AB
+//Valid Gray code steps give +1/-1, no change or both pins toggled (bounce) give 0
+const int8_t enc_table[16] PROGMEM = {0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0};
+
+int encoder_take(int);
+int encoder_detents(void);
+uint16_t get_ticks(void);
 
 //Seconds counting
 long runseconds10 =  0;
 
 //METER
-int sv_old = 0;
-int smax = 0;
+int sv_old = 0; //Last bar length, -1 = redraw whole bar
 long runseconds10s = 0;
 
+//Peak hold marker of meter
+#define PEAK_HOLD 15   //Hold time in 1/10 s
+#define PEAK_DECAY 512 //Decay per 1/10 s in 1/256 bar columns (20 columns/s)
+volatile unsigned int peak_val = 0; //Peak value, 8.8 fixed point bar columns
+volatile uint8_t peak_hold = 0;     //Remaining hold time in 1/10 s
+int peak_old = -1;                  //Column of marker on screen, -1 = none
+
 //Interfrequency options
 #define IFOPTION 0
 
+//Frequency plan of Si5351
+//0: PLLs fixed at PLLRATIO * 25 MHz, tuning by fractional multisynth
+//1: Even integer multisynth, tuning by fractional PLL (less jitter, fewer bytes per step)
+#ifndef SYNTHOPTION
+#define SYNTHOPTION 0
+#endif
+
+//Latency statistics encoder edge > tuning logic > Si5351 > OLED (debug aid)
+//0: off, 1: histograms in SRAM, shown after key 2 (store) until next key press
+#ifndef LATENCYSTATS
+#define LATENCYSTATS 0
+#endif
+
 #if (IFOPTION == 0) //9MHz Filter 9XMF24D (box73.de)
     #define INTERFREQUENCY 9000000
     #define F_LO_LSB 8998600
@@ -127,6 +172,7 @@ long f_vfo[MAXVFO + 1]; //Stores freqencies of 2 VFOs
 #define OLEDCMD 0x00   //Command follows
 #define OLEDDATA 0x40  //Data follows
 #define OLEDADDR 0x78  //address for the chip - usually 0x7C or 0x78. 
+#define OLEDCHUNK 253  //Max. data bytes per transaction (+ control byte < 255)
 
 #define FONTW 6
 #define FONTH 8
@@ -139,6 +185,27 @@ long f_vfo[MAXVFO + 1]; //Stores freqencies of 2 VFOs
 #define S_LCDWIDTH               128
 #define S_LCDHEIGHT              64 
 
+//Frame buffer, 1 byte = 8 vertical pixels of one page
+uint8_t oled_fb[S_LCDHEIGHT / 8][S_LCDWIDTH];
+uint8_t oled_dx0[S_LCDHEIGHT / 8]; //Dirty columns per page: dx0 <= x < dx1
+uint8_t oled_dx1[S_LCDHEIGHT / 8];
+uint8_t oled_cx = 0, oled_cy = 0;  //Write position in frame buffer
+
+//Update priority of pages for oled_flush_budget()
+//0: Frequency, 1: Meter and scale, 2: Status and telemetry
+#define OLEDWINDOW 12   //Queue bytes of a window besides its data (9 + 3)
+#define OLEDMAXDEFER 8  //Max. number of passes a page is put back
+const uint8_t oled_prio[S_LCDHEIGHT / 8] PROGMEM = {2, 2, 2, 2, 0, 0, 1, 1};
+//Pages sent as one unit: number of pages from here, 0 = part of the unit
+//above (double height frequency digits on pages 4 and 5)
+const uint8_t oled_span[S_LCDHEIGHT / 8] PROGMEM = {1, 1, 1, 1, 2, 0, 1, 1};
+uint8_t oled_defer[S_LCDHEIGHT / 8]; //Passes the page has been put back
+
+//Bus load counters (IC bytes incl. address and transactions)
+unsigned long oled_bytes = 0;
+unsigned int oled_transactions = 0;
+uint16_t oled_ticket = 0; //TWI ticket of last transaction
+
 // Font 6x8 for OLED
 #define FONTWIDTH 6
 const char font[][6] PROGMEM={
@@ -248,13 +315,43 @@ const char font[][6] PROGMEM={
 {0x00,0x06,0x09,0x09,0x06,0x00}    //87 
 };	
 
+//Double height: every bit of a nibble doubled, e.g. 0101 => 00110011
+const uint8_t dblnibble[16] PROGMEM = {0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+                                       0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF};
+
   ///////////////////////////
  //  OLED DECLARATIONS    // 
 ///////////////////////////
 //IC
+#define TWI_BUFSIZE 64 //Must be power of 2
+#define TWI_MAXLEN 254 //Bytes after address, ISR counts len + 1 in 8 bits
+
+#if (OLEDCHUNK + 1 > TWI_MAXLEN)
+#error "OLEDCHUNK too large for one TWI transaction"
+#endif
+
+#define TWI_IDLE 0
+#define TWI_BUSY 1
+#define TWI_STALLED 2
+#define TWI_RESUMED 3 //TWINT still set from before the stall, status already handled
+
+volatile uint8_t twi_buf[TWI_BUFSIZE]; //Transaction queue
+volatile uint8_t twi_head = 0;   //Next free position (written by main)
+volatile uint8_t twi_tail = 0;   //Next byte to send (written by ISR)
+volatile uint8_t twi_left = 0;   //Bytes left in current transaction
+volatile uint8_t twi_skip = 0;   //Bytes to drop after bus error
+volatile uint8_t twi_state = TWI_IDLE;
+volatile uint16_t twi_done = 0;  //Number of transactions completed
+uint16_t twi_queued = 0;         //Number of transactions queued
+volatile uint16_t twi_errors = 0;
+
 void twi_init(void);
-void twi_sart(void);
-void twi_stop(void);
+void twi_put(uint8_t);
+uint16_t twi_begin(uint8_t, uint8_t);
+void twi_wait(uint16_t);
+int twi_passed(uint16_t);
+void twi_sync(void);
+uint8_t twi_room(void);
 
 //OLED
 void oled_command(int value);
@@ -263,19 +360,46 @@ void oled_gotoxy(unsigned int, unsigned int);
 void oled_cls(int);
 void oled_init(void);
 void oled_byte(unsigned char);
+void oled_flush(void);
+void oled_flush_budget(void);
+void oled_send_window(int, int, int, int);
+void oled_glyph(unsigned char, int);
 void oled_putchar1(unsigned int x, unsigned int y, unsigned char ch, int);
 void oled_putchar2(unsigned int x, unsigned int y, unsigned char ch, int);
 void oled_putnumber(int, int, long, int, int, int);
 void oled_putstring(int, int, char*, char, int);
 void oled_write_section(int, int, int, int);
+void oled_fill(int, int, int, int, int);
 void oled_drawbox(int, int, int, int);
 void draw_meter_scale(int);
 
 //String
+const unsigned long pow10tab[10] PROGMEM = {1000000000, 100000000, 10000000, 1000000, 100000,
+                                            10000, 1000, 100, 10, 1};
 int int2asc(long num, int dec, char *buf, int buflen);
 int strlen(char *s);
 
 //Data display functions
+#define W_VFO 0
+#define W_SIDEBAND 1
+#define W_TXRX 2
+#define W_VOLTAGE 3
+#define W_TEMP 4
+#define W_AGC 5
+#define W_TONE 6
+#define W_MEM 7
+#define W_SPLIT 8
+#define W_SCALE 9
+#define WIDGETS 10
+#define W_INVALID -32768
+int widget_val[WIDGETS]; //Last value shown per status field
+
+int widget_changed(int, int);
+void widget_invalidate(void);
+uint8_t freq_bcd_get(int);
+void freq_bcd_put(int, uint8_t);
+void freq_bcd_set(long);
+void freq_bcd_add(long);
 void show_frequency(long, int);
 void show_vfo(int, int);
 void show_sideband(int, int);
@@ -287,16 +411,49 @@ void show_agc(int, int);
 void show_split(int);
 void show_mem_num(int, int);
 void show_meter(int);
-void reset_smax(void);
+int meter_cols(uint8_t, int);
+void meter_peak_sample(int);
+void meter_peak_reset(int);
 
 //MISC
 int main(void);
 
 //Keys, TX & ADC
+//ADC scanner: timer 0 triggers conversions, ADC_vect stores them round robin
+#define ADC_CHANNELS 5
+#define ADC_TIMER_TOP 124 //16 MHz / 64 / 125 = 2000 conversions/s, 400/s per channel
+const uint8_t adc_chan[ADC_CHANNELS] PROGMEM = {0, 1, 2, 3, 6}; //Keys, S-meter, voltage, TX power, temp.
+#define ADC_SLOT_S 1   //Position of S-meter in adc_chan[]
+#define ADC_SLOT_PWR 3 //Position of TX power in adc_chan[]
+volatile uint16_t adc_res[2][ADC_CHANNELS]; //Double buffered results
+volatile uint8_t adc_front = 0;             //Buffer holding last complete round
+volatile uint16_t adc_samples[ADC_CHANNELS]; //Conversions per channel (for rate check)
+uint8_t adc_idx = 0;                        //Channel being converted
+
+//Oversampling and IIR smoothing per channel, done in ADC_vect
+#define ADC_OVERSAMPLE 4  //Conversions averaged per filtered sample (power of 2)
+#define ADC_OVERSHIFT 2   //log2(ADC_OVERSAMPLE)
+#define ADC_FRAC 5        //Fractional bits of smoothed values
+const uint8_t adc_attack[ADC_CHANNELS] PROGMEM = {0, 1, 3, 1, 4}; //IIR shift for rising input, 0 = off
+const uint8_t adc_decay[ADC_CHANNELS] PROGMEM = {0, 4, 3, 3, 4};  //IIR shift for falling input
+uint16_t adc_acc[ADC_CHANNELS];          //Sums for oversampling
+volatile uint8_t adc_round = 0;          //Complete rounds of all channels
+volatile int16_t adc_filt[ADC_CHANNELS]; //Smoothed values
+volatile uint8_t peak_slot = ADC_SLOT_S;  //Slot whose averaged values feed the meter peak
+
+#define ADC_RAW 0
+#define ADC_SMOOTH 1
+
+void adc_init(void);
+int16_t adc_iir(int16_t, uint16_t, uint8_t);
+int get_adc_val(int, int);
+void adc_wait_sample(void);
 int get_adc(int);
 int get_keys(void);
 int get_s_value(void);
 int get_temp(void);
+int adc2temp(int);
+int adc2volt(int);
 int get_tx_pwr_value(void);
 int get_txrx(void);
 
@@ -341,6 +498,7 @@ int set_scan_threshold(int);
 int calc_tuningfactor(void);
 void set_vfo_frequency(long);
 void set_lo_frequency(long);
+int tune_vfo(int);
 
 void adj_lo_frequency(int);
 
@@ -348,8 +506,9 @@ void adj_lo_frequency(int);
  //   Si5351   Defines and Declarations    //
 ////////////////////////////////////////////
 #define SI5351_ADDRESS 0xC0 // 0b11000000 for my module. Others may vary! The 0x60 did NOT work with my module!
+#define F_XTAL 25000000
 #define PLLRATIO 36
-#define CFACTOR 1048575
+#define CFACTOR 1048575 //2^20 - 1
 
 //Set of Si5351A register addresses
 #define CLK_ENABLE_CONTROL       3
@@ -365,17 +524,76 @@ void adj_lo_frequency(int);
 #define PLL_RESET              177
 #define XTAL_LOAD_CAP          183
 
-#undef F_CPU
-#define F_CPU 8000000
+//Bus load counters (IC bytes incl. address and transactions)
+unsigned long si5351_bytes = 0;
+unsigned int si5351_transactions = 0;
+uint16_t si5351_ticket = 0; //TWI ticket of last transaction
+
+//Retune mailbox: f_vfo[cur_vfo] holds the target (latest wins),
+//f_synth is what the Si5351 has been set to
+long f_synth = 0;
+
+//RAM shadow of PLL and multisynth register blocks (regs 26...65)
+#define SI5351_SHADOW_SIZE (SYNTH_MS_2 + 8 - SYNTH_PLL_A)
+uint8_t si5351_shadow[SI5351_SHADOW_SIZE];
+uint8_t si5351_shadow_valid = 0; //1 bit per 8 byte block
+
+//Last state of MS0...MS2 for incremental tuning
+#define SI5351_MAXSTEP 100000 //Larger steps are calculated from scratch
+unsigned long si5351_ms_f[3] = {0, 0, 0}; //Frequency (0 = unknown)
+unsigned long si5351_ms_a[3];             //Integer part of division
+unsigned long si5351_ms_r[3];             //fvco - a * f
+
+//TWI queue bytes of one retune: multisynth and PLL block, PLL reset
+#define SI5351_QUEUE (2 * (9 + 2) + 4)
+#if (TWI_BUFSIZE - 1 - SI5351_QUEUE < OLEDWINDOW + 2)
+#error "TWI queue leaves no room for the display next to a retune"
+#endif
+
+#define SI5351_VCO_MIN 600000000
+#define SI5351_VCO_MAX 900000000
+unsigned long si5351_ms_n[3] = {0, 0, 0}; //Integer divider of MS0...MS2 (SYNTHOPTION 1)
 
 void si5351_write(int, int);
+void si5351_write_burst(int, uint8_t*, int);
+void si5351_write_block(int, uint8_t*);
+void si5351_invalidate(void);
+void si5351_pack_regs(uint8_t*, unsigned long, unsigned long, unsigned long);
+unsigned long si5351_calc_b(unsigned long, unsigned long);
+void si5351_calc_div_step(int, unsigned long, unsigned long*, unsigned long*);
+void si5351_calc_p(unsigned long, unsigned long, unsigned long*, unsigned long*);
 void si5351_start(void);
 void si5351_set_freq(int, unsigned long);
+#if (SYNTHOPTION == 1)
+unsigned long si5351_plan_div(unsigned long, unsigned long);
+void si5351_set_ms_int(int, unsigned long);
+#endif
 
   /////////////////////////////
  //   Misc. Declarations    //
 /////////////////////////////
-char *oldbuf = "         ";
+#define FREQDIGITS 8         //Characters of frequency on display ("14200.00")
+#define FREQBCDDIGITS 8      //Digits in BCD counter (1Hz...10MHz)
+#define FREQBCDSTEPDIGITS 5  //Digits of largest incremental step
+#define FREQBCDMAXSTEP 100000 //Larger jumps are converted from scratch
+char freq_digits[FREQDIGITS]; //Characters of frequency on display
+uint8_t freq_bcd[FREQBCDDIGITS / 2]; //Packed BCD of shown frequency, 1Hz digit first
+long freq_bcd_f = 0; //Frequency held in freq_bcd[] (0 = none)
+
+#if (LATENCYSTATS == 1)
+#define LAT_STAGES 3      //0: tuning logic, 1: Si5351 write done, 2: OLED flush done
+#define LAT_BUCKETS 16    //Bucket n: 2^n...2^(n+1)-1 ticks of 64us
+#define LAT_TIMEOUT 31250 //Measurements older than 2 s are dropped
+uint16_t lat_hist[LAT_STAGES][LAT_BUCKETS];
+uint16_t lat_t0 = 0;     //Encoder edge being measured
+uint8_t lat_pending = 0; //Bit n: stage n not reached yet
+char *lat_name[LAT_STAGES] = {"LOGIC", "SI5351", "OLED"};
+
+void lat_start(void);
+void lat_check(long);
+void lat_record(int);
+void lat_show(void);
+#endif
 
 
   ///////////////////////////
@@ -384,23 +602,133 @@ char *oldbuf = "         ";
 ISR(TIMER1_COMPA_vect)
 {
     runseconds10++; 
-    tuningcount = 0;
+    
+    //Peak hold and decay of meter
+    if(peak_hold)
+    {
+		peak_hold--;
+	}
+	else if(peak_val > PEAK_DECAY)
+	{
+		peak_val -= PEAK_DECAY;
+	}
+	else
+	{
+		peak_val = 0;
+	}		
+}
+
+//ADC conversion complete: store result, select next channel
+ISR(ADC_vect)
+{
+	uint8_t back = adc_front ^ 1;
+	uint16_t x = ADCW;
+	
+	adc_res[back][adc_idx] = x;
+	adc_samples[adc_idx]++;
+	
+	//Oversampling, last round of a block averages and filters
+	adc_acc[adc_idx] += x;
+	if((adc_round & (ADC_OVERSAMPLE - 1)) == ADC_OVERSAMPLE - 1)
+	{
+		x = adc_acc[adc_idx] >> ADC_OVERSHIFT;
+		adc_acc[adc_idx] = 0;
+		adc_filt[adc_idx] = adc_iir(adc_filt[adc_idx], x, adc_idx);
+		if(adc_idx == peak_slot) //Peak hold of meter at sample rate
+		{
+			meter_peak_sample(meter_cols(adc_idx, x));
+		}
+	}
+	
+	if(++adc_idx >= ADC_CHANNELS)
+	{
+		adc_idx = 0;
+		adc_round++;
+		adc_front = back; //Round complete, swap buffers
+	}
+	ADMUX = (1<<REFS0) | pgm_read_byte(&adc_chan[adc_idx]);
+	TIFR0 = (1 << OCF0A); //Clear flag so next compare match triggers again
 }
 
 //Rotary encoder
 ISR(PCINT2_vect)
 { 
-	int gray = (PIND & 0x60) >> 5;           // Read PD5 and PD6
-    	
-    int state = (gray >> 1) ^ gray;         // Convert from Gray code to binary
-
-    if (state != laststate)                //Compare states
-    {        
-        tuningknob += ((laststate - state) & 0x03) - 2; // Results in -1 or +1
-        laststate = state;
-        tuningcount += 2;
-    } 
-	PCIFR |=  (1 << PCIF0); // Clear pin change interrupt flag.
+	uint8_t gray = (PIND & 0x60) >> 5;           // Read PD5 and PD6
+	int8_t step = pgm_read_byte(&enc_table[(laststate << 2) | gray]);
+	uint16_t now, dt;
+	
+	if(step)
+	{
+		tuningknob += step;
+		
+		now = get_ticks();
+		dt = now - enc_time;
+		enc_time = now;
+		
+		//Smoothed interval, restart slow after pause or reversal
+		if(dt >= ENC_DT_MAX || step != enc_dir)
+		{
+			enc_dt = ENC_DT_MAX;
+		}
+		else
+		{
+			enc_dt = enc_dt - (enc_dt >> 2) + (dt >> 2);
+		}
+		enc_dir = step;
+	}
+	laststate = gray; //PCIF2 is cleared by hardware when entering ISR
+}
+
+//Atomic snapshot-and-reset of encoder steps
+//Counts up to +/-thresh are kept for the next call and 0 is returned
+int encoder_take(int thresh)
+{
+	int steps;
+	
+	cli();
+	steps = tuningknob;
+	if(steps > thresh || steps < -thresh)
+	{
+		tuningknob = 0;
+	}
+	else
+	{
+		steps = 0;
+	}
+	sei();
+	
+	return steps;
+}
+
+//Timestamp in ticks of 64us from 1/10 s counter and timer 1 (wraps after 4 s)
+uint16_t get_ticks(void)
+{
+	uint16_t now;
+	uint8_t sreg = SREG; //Also called from ISR
+	
+	cli();
+	now = TCNT1;
+	if((TIFR1 & (1 << OCF1A)) && now < (TIMER1_TOP >> 1))
+	{
+		now += TIMER1_TOP + 1; //Compare match not yet counted
+	}
+	now += (uint16_t) runseconds10 * (TIMER1_TOP + 1);
+	SREG = sreg;
+	
+	return now;
+}
+
+//Atomically take full detents, remaining transitions are kept
+int encoder_detents(void)
+{
+	int steps;
+	
+	cli();
+	steps = tuningknob / ENC_DETENT;
+	tuningknob -= steps * ENC_DETENT;
+	sei();
+	
+	return steps;
 }
 
 
@@ -409,6 +737,9 @@ ISR(PCINT2_vect)
 //         TWI
 //
 ///////////////////////////
+//Transactions are queued into a ring buffer and sent by TWI_vect,
+//so callers return as soon as their bytes are stored.
+//Each transaction in the queue: [length][address][length bytes]
 
 void twi_init(void)
 {
@@ -416,28 +747,164 @@ void twi_init(void)
     TWSR = 0x00;
     TWBR = 0x0C;
 	
+    twi_head = 0;
+    twi_tail = 0;
+    twi_left = 0;
+    twi_skip = 0;
+    twi_state = TWI_IDLE;
+    
     //enable TWI
     TWCR = (1<<TWEN);
 }
 
-//Send start signal
-void twi_start(void)
+//Store one byte in queue, wait if queue is full
+//(the main loop checks twi_room() first, menus and full flushes wait)
+void twi_put(uint8_t u8data)
+{
+    uint8_t next = (twi_head + 1) & (TWI_BUFSIZE - 1);
+    
+    if(twi_skip) //Rest of a transaction aborted by bus error
+    {
+        twi_skip--;
+        return;
+    }
+    
+    while(next == twi_tail); //Wait for ISR to make room
+    
+    twi_buf[twi_head] = u8data;
+    twi_head = next;
+    
+    //ISR ran out of data in the middle of a transaction => resume
+    if(twi_state == TWI_STALLED)
+    {
+        twi_state = TWI_RESUMED;
+        TWCR = (1<<TWEN)|(1<<TWIE); //TWINT still set, so ISR fires at once
+    }
+}
+
+//Open a new transaction with 'len' bytes following the address
+//(at most TWI_MAXLEN), returns ticket number for twi_wait()
+uint16_t twi_begin(uint8_t addr, uint8_t len)
+{
+    twi_put(len);
+    twi_put(addr);
+    
+    if(twi_state == TWI_IDLE)
+    {
+        twi_state = TWI_BUSY;
+        TWCR = (1<<TWINT)|(1<<TWSTA)|(1<<TWEN)|(1<<TWIE);
+    }
+    
+    return ++twi_queued;
+}
+
+//Check without waiting if transaction with ticket 'ticket' has been sent
+int twi_passed(uint16_t ticket)
+{
+    uint16_t d;
+    uint8_t sreg = SREG; //Keep I flag of caller
+    
+    cli();
+    d = twi_done;
+    SREG = sreg;
+    
+    return (int16_t) (d - ticket) >= 0;
+}
+
+//Wait until transaction with ticket 'ticket' has been sent
+void twi_wait(uint16_t ticket)
 {
-    TWCR = (1<<TWINT)|(1<<TWSTA)|(1<<TWEN);
-    while ((TWCR & (1<<TWINT)) == 0);
+    while(!twi_passed(ticket));
 }
 
-//send stop signal
-void twi_stop(void)
+//Wait until queue is empty and bus has been released
+void twi_sync(void)
 {
-    TWCR = (1<<TWINT)|(1<<TWSTO)|(1<<TWEN);
+    while(twi_state != TWI_IDLE);
 }
 
-void twi_write(uint8_t u8data)
+//Bytes that can be stored with twi_put() without waiting
+//(a transaction takes len + 2)
+uint8_t twi_room(void)
 {
-    TWDR = u8data;
-    TWCR = (1<<TWINT)|(1<<TWEN);
-    while ((TWCR & (1<<TWINT)) == 0);
+    return (twi_tail - twi_head - 1) & (TWI_BUFSIZE - 1);
+}
+
+//Take next byte from queue (ISR only)
+static uint8_t twi_get(void)
+{
+    uint8_t u8data = twi_buf[twi_tail];
+    twi_tail = (twi_tail + 1) & (TWI_BUFSIZE - 1);
+    return u8data;
+}
+
+ISR(TWI_vect)
+{
+    if(twi_state == TWI_RESUMED)
+    {
+        //Status was evaluated before stalling, just carry on sending
+        twi_state = TWI_BUSY;
+    }
+    else
+    {
+        switch(TW_STATUS)
+        {
+            case TW_START:
+            case TW_REP_START:
+                twi_left = twi_get() + 1; //Data plus address byte
+                break;
+            
+            case TW_MT_SLA_ACK:
+            case TW_MT_DATA_ACK:
+                break;
+            
+            case TW_MT_SLA_NACK:
+            case TW_MT_DATA_NACK:
+                twi_errors++; //Keep on clocking out bytes to stay in sync with queue
+                break;
+            
+            default: //Bus error or arbitration lost: drop rest of transaction
+                twi_errors++;
+                while(twi_left && twi_head != twi_tail)
+                {
+                    twi_get();
+                    twi_left--;
+                }
+                twi_skip += twi_left; //Bytes not stored yet are dropped by twi_put()
+                twi_left = 0;
+                break;
+        }
+    }
+    
+    if(twi_left)
+    {
+        if(twi_head == twi_tail)
+        {
+            //Producer has not stored the next byte yet
+            //Leave TWINT set (SCL is held low) and sleep until twi_put()
+            twi_state = TWI_STALLED;
+            TWCR = (1<<TWEN);
+            return;
+        }
+        TWDR = twi_get();
+        twi_left--;
+        TWCR = (1<<TWINT)|(1<<TWEN)|(1<<TWIE);
+        return;
+    }
+    
+    //Transaction complete
+    twi_done++;
+    
+    if(twi_head != twi_tail && !twi_skip)
+    {
+        //STOP followed by START of next transaction
+        TWCR = (1<<TWINT)|(1<<TWSTO)|(1<<TWSTA)|(1<<TWEN)|(1<<TWIE);
+    }
+    else
+    {
+        TWCR = (1<<TWINT)|(1<<TWSTO)|(1<<TWEN);
+        twi_state = TWI_IDLE;
+    }
 }
 
 ////////////////////////////////
@@ -449,89 +916,246 @@ void twi_write(uint8_t u8data)
 //Send comand to OLED
 void oled_command(int value)
 {
-   twi_start();
-   twi_write(OLEDADDR); //Device address
-   twi_write(OLEDCMD);  //Command follows
-   twi_write(value);    //
-   twi_stop();
+   twi_begin(OLEDADDR, 2); //Device address
+   twi_put(OLEDCMD);  //Command follows
+   twi_put(value);    //
 } 
 
 //Send a 'number' bytes of data to display - from RAM
 void oled_data(unsigned int *data, unsigned int number)
 {
    int t1;
-   twi_start();
-   twi_write(OLEDADDR); //Device address
-   twi_write(OLEDDATA); //Data follows
    
    for(t1 = 0; t1 < number; t1++)
    {
-      twi_write(data[t1]); //send the byte(s)
+      oled_byte(data[t1]); //send the byte(s)
    }   
-   twi_stop ();   
 } 
 
-//Set "cursor" to current position to screen
+//Set "cursor" to current position in frame buffer
 void oled_gotoxy(unsigned int x, unsigned int y)
 {
-   int x2 = x; // + 2;
-   twi_start();
-   twi_write(OLEDADDR); //Select display  I2C address
-   twi_write(OLEDCMD);  //Be ready for command
-   twi_write(S_PAGEADDR + y); //Select display row
-   twi_write(S_SETLOWCOLUMN + (x2 & 0x0F)); //Col addr lo byte
-   twi_write(S_SETHIGHCOLUMN + ((x2 >> 4) & 0x0F)); //Col addr hi byte
-   twi_stop();
+   oled_cx = x;
+   oled_cy = y;
 }
 
 void oled_cls(int invert)
 {
-    unsigned int row, col;
-
     //Just fill the memory with zeros
-    for(row = 0; row < S_LCDHEIGHT / 8; row++)
+    if(!invert)
+    {
+        oled_fill(0, S_LCDWIDTH, 0, S_LCDHEIGHT / 8, 0); //normal
+    }   
+    else
+    {
+        oled_fill(0, S_LCDWIDTH, 0, S_LCDHEIGHT / 8, 255); //inverse
+    } 
+    oled_gotoxy(0, 0); //Return to 0, 0
+    widget_invalidate(); //New screen
+    sv_old = -1;         //Meter bar and peak marker drawn in full
+    peak_old = -1;
+}
+
+//Fill columns x1...x2-1 of rows row1...row2-1 with pattern
+void oled_fill(int x1, int x2, int row1, int row2, int pattern)
+{
+    int row, col;
+    
+    for(row = row1; row < row2; row++)
     {
-        oled_gotoxy(0, row); //Set OLED address
-        twi_start();
-        twi_write(OLEDADDR); //Select OLED
-        twi_write(OLEDDATA); //Data follows
-        for(col = 0; col < S_LCDWIDTH; col++)
+        oled_gotoxy(x1, row);
+        for(col = x1; col < x2; col++)
         {
-            if(!invert)
-            {
-                twi_write (0); //normal
-            }   
-            else
-            {
-                twi_write(255); //inverse
-            } 
+            oled_byte(pattern);
         }
-        twi_stop();
     }
-    oled_gotoxy(0, 0); //Return to 0, 0
 }
 
 //Write number of bitmaps to one row of screen
 void oled_write_section(int x1, int x2, int row, int number)
 {
-    int t1;
-    oled_gotoxy(x1, row);
-    	
-    twi_start();
-    twi_write(OLEDADDR); //Device address
-    twi_write(OLEDDATA); //Data follows
-   
-    for(t1 = x1; t1 < x2; t1++)
+    oled_fill(x1, x2, row, row + 1, number);
+}
+
+//Send rows row...row2-1, columns x0...x1-1 of frame buffer to display
+//as one column/page window (0x21/0x22) and clear their dirty ranges
+//(up to x1 if the rows are dirty beyond it).
+//Data is streamed in transactions of up to OLEDCHUNK bytes, the
+//SSD1306 keeps its address pointer from one transaction to the next.
+void oled_send_window(int row, int row2, int x0, int x1)
+{
+    int r, col, n, total;
+    
+    twi_begin(OLEDADDR, 7);
+    twi_put(OLEDCMD);
+    twi_put(0x21); //Column window
+    twi_put(x0);
+    twi_put(x1 - 1);
+    twi_put(0x22); //Page window
+    twi_put(row);
+    twi_put(row2 - 1);
+    oled_bytes += 8; //Incl. address and control byte
+    oled_transactions++;
+    
+    total = (x1 - x0) * (row2 - row);
+    n = 0;
+    for(r = row; r < row2; r++)
     {
-       twi_write(number); //send the byte(s)
-    }    
-    twi_stop ();   
+        for(col = x0; col < x1; col++)
+        {
+            if(!n) //Start next data transaction
+            {
+                n = (total > OLEDCHUNK) ? OLEDCHUNK : total;
+                total -= n;
+                oled_ticket = twi_begin(OLEDADDR, n + 1);
+                twi_put(OLEDDATA);
+                oled_bytes += n + 2;
+                oled_transactions++;
+            }
+            twi_put(oled_fb[r][col]);
+            n--;
+        }
+        if(oled_dx1[r] > x1)
+        {
+            if(oled_dx0[r] < x1)
+            {
+                oled_dx0[r] = x1;
+            }
+        }
+        else
+        {
+            oled_dx0[r] = S_LCDWIDTH;
+            oled_dx1[r] = 0;
+        }
+        oled_defer[r] = 0;
+    }
+}
+
+//Send all changed parts of frame buffer to display
+//Dirty ranges of neighbouring pages are joined into one window
+//if that costs fewer bytes than another window (10 bytes overhead)
+void oled_flush(void)
+{
+    int row = 0, row2;
+    int x0, x1, nx0, nx1;
+    
+    while(row < S_LCDHEIGHT / 8)
+    {
+        if(oled_dx0[row] >= oled_dx1[row])
+        {
+            row++;
+            continue;
+        }
+        
+        x0 = oled_dx0[row];
+        x1 = oled_dx1[row];
+        for(row2 = row + 1; row2 < S_LCDHEIGHT / 8 && oled_dx0[row2] < oled_dx1[row2]; row2++)
+        {
+            nx0 = (oled_dx0[row2] < x0) ? oled_dx0[row2] : x0;
+            nx1 = (oled_dx1[row2] > x1) ? oled_dx1[row2] : x1;
+            
+            //Joined window vs. current window + separate window
+            if((nx1 - nx0) * (row2 - row + 1) > (x1 - x0) * (row2 - row) + oled_dx1[row2] - oled_dx0[row2] + 10)
+            {
+                break;
+            }
+            x0 = nx0;
+            x1 = nx1;
+        }
+        
+        oled_send_window(row, row2, x0, x1);
+        row = row2;
+    }
 }
 
+//Unit of pages row...row2-1 is dirty and taken in pass 'pass' of
+//oled_flush_budget(): pass 0 pages put back too often, passes 1...3
+//priority 0...2
+static int oled_pick(int row, int row2, int pass)
+{
+    int r, dirty = 0, forced = 0;
+    
+    for(r = row; r < row2; r++)
+    {
+        if(oled_dx0[r] < oled_dx1[r])
+        {
+            dirty = 1;
+            forced |= oled_defer[r] >= OLEDMAXDEFER;
+        }
+    }
+    if(!dirty || forced != !pass)
+    {
+        return 0;
+    }
+    return !pass || pgm_read_byte(&oled_prio[row]) == pass - 1;
+}
+
+//Send changed pages in order of priority (oled_prio[]) as long as the
+//TWI queue takes them without waiting; the free room of the queue less
+//SI5351_QUEUE bytes kept for retuning is the budget of one pass (at most
+//TWI_BUFSIZE - 1 - SI5351_QUEUE bytes).
+//Pages of a unit (oled_span[]) always go as one window, so both halves
+//of the big frequency digits are sent column by column together. A
+//window that does not fit is sent from the left as far as it goes, the
+//rest stays dirty for a later call (latest content only). Units that
+//have been put back OLEDMAXDEFER times without any progress go first.
+void oled_flush_budget(void)
+{
+    int pass, row, row2, r, x0, x1, n;
+    int left = twi_room() - SI5351_QUEUE;
+    
+    if(left <= OLEDWINDOW) //Queue full, nobody is put back
+    {
+        return;
+    }
+    
+    for(pass = 0; pass < 4; pass++)
+    {
+        for(row = 0; row < S_LCDHEIGHT / 8; row = row2)
+        {
+            row2 = row + pgm_read_byte(&oled_span[row]);
+            if(!oled_pick(row, row2, pass))
+            {
+                continue;
+            }
+            
+            x0 = S_LCDWIDTH;
+            x1 = 0;
+            for(r = row; r < row2; r++)
+            {
+                x0 = (oled_dx0[r] < x0) ? oled_dx0[r] : x0;
+                x1 = (oled_dx1[r] > x1) ? oled_dx1[r] : x1;
+            }
+            
+            n = (left - OLEDWINDOW) / (row2 - row); //Columns that fit
+            if(n > x1 - x0)
+            {
+                n = x1 - x0;
+            }
+            if(n > 0)
+            {
+                oled_send_window(row, row2, x0, x0 + n);
+                left -= n * (row2 - row) + OLEDWINDOW;
+            }
+            else
+            {
+                for(r = row; r < row2; r++)
+                {
+                    if(oled_dx0[r] < oled_dx1[r] && oled_defer[r] < OLEDMAXDEFER)
+                    {
+                        oled_defer[r]++;
+                    }
+                }
+            }
+        }
+    }
+}
 
 //Initialize OLED
 void oled_init(void)
 {
+    int t1;
+    
     oled_command(0xAE); // Display OFF
 	oled_command(0x20); // Set Memory Addressing Mode
     oled_command(0x00); // HOR
@@ -562,112 +1186,121 @@ void oled_init(void)
     oled_command(0x8D);
     oled_command(0x14);    // Set DC-DC enabl
     oled_command(0xAF);    //Display ON
-   
+    
+    //Display RAM content is unknown => send whole frame buffer with next flush
+    for(t1 = 0; t1 < S_LCDHEIGHT / 8; t1++)
+    {
+        oled_dx0[t1] = 0;
+        oled_dx1[t1] = S_LCDWIDTH;
+    }
 } 
 
 //Write 1 byte pattern to screen using vertical orientation 
+//Bytes are stored in frame buffer, oled_flush() sends changed ones
 void oled_byte(unsigned char value)
 {
-   twi_start();
-   twi_write(OLEDADDR); //Device address
-   twi_write(OLEDDATA); //Data follows
-   twi_write(value);
-   twi_stop ();   
+   if(oled_cx < S_LCDWIDTH && oled_cy < S_LCDHEIGHT / 8)
+   {
+      if(oled_fb[oled_cy][oled_cx] != value)
+      {
+         oled_fb[oled_cy][oled_cx] = value;
+         
+         //Extend dirty range of page
+         if(oled_cx < oled_dx0[oled_cy])
+         {
+            oled_dx0[oled_cy] = oled_cx;
+         }
+         if(oled_cx >= oled_dx1[oled_cy])
+         {
+            oled_dx1[oled_cy] = oled_cx + 1;
+         }
+      }
+   }
+   oled_cx++;
 }
 
-//Write character to screen (normal size);
-void oled_putchar1(unsigned int x, unsigned int y, unsigned char ch, int invert)
+//Write glyph columns of character at current position (normal size)
+void oled_glyph(unsigned char ch, int invert)
 {
 	int t0;
-		
-	oled_gotoxy(x, y);
+	const char *p = font[ch - 32];
+	uint8_t mask = invert ? 0xFF : 0x00;
+	
 	for(t0 = 0; t0 < FONTW; t0++)
 	{
-		if(!invert)
-		{
-            oled_byte(pgm_read_byte(&font[ch - 32][t0]));
-        }
-        else    
-        {
-            oled_byte(~pgm_read_byte(&font[ch - 32][t0]));
-        }
-        
+		oled_byte(pgm_read_byte(p++) ^ mask);
 	}
+}
+
+//Write character to screen (normal size);
+void oled_putchar1(unsigned int x, unsigned int y, unsigned char ch, int invert)
+{
+	oled_gotoxy(x, y);
+	oled_glyph(ch, invert);
 }		
 
 //Write character to screen (DOUBLE size);
+//Each font column is doubled in width, each pixel in height via dblnibble[]
 void oled_putchar2(unsigned int x, unsigned int y, unsigned char ch, int invert)
 {
-	int t0, t1;
-	char c;
-	int i[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	int t0;
+	uint8_t c[FONTW];
+	const char *p = font[ch - 32];
+	uint8_t mask = invert ? 0xFF : 0x00;
 	
 	for(t0 = 0; t0 < FONTW; t0++)
 	{
-		for(t1 = 0; t1 < 8; t1++)
-		{
-			if(!invert)
-			{
-				c = pgm_read_byte(&font[ch - 32][t0]);
-			}
-			else
-			{
-				c = ~pgm_read_byte(&font[ch - 32][t0]);
-			}
-				
-		    if(c & (1 << t1))
-		    {
-			    i[t0] += (1 << (t1 * 2));
-			    i[t0] += (1 << (t1 * 2 + 1));
-		    }	
-	    }
+		c[t0] = pgm_read_byte(p++) ^ mask;
 	}
 	
-	oled_gotoxy(x, y);
+	oled_gotoxy(x, y); //Upper half: bits 0:3
 	for(t0 = 0; t0 < FONTW; t0++)
 	{		
-	    oled_byte(i[t0] & 0xFF);
-	    oled_byte(i[t0] & 0xFF);
+		uint8_t b = pgm_read_byte(&dblnibble[c[t0] & 0x0F]);
+	    oled_byte(b);
+	    oled_byte(b);
 	}
 	
-	oled_gotoxy(x, y + 1);
+	oled_gotoxy(x, y + 1); //Lower half: bits 4:7
 	for(t0 = 0; t0 < FONTW; t0++)
 	{		
-	    oled_byte((i[t0] & 0xFF00) >> 8);
-	    oled_byte((i[t0] & 0xFF00) >> 8);
+		uint8_t b = pgm_read_byte(&dblnibble[c[t0] >> 4]);
+	    oled_byte(b);
+	    oled_byte(b);
 	}
 }		
 
 //Print string in given size
 //lsize=0 => normal height, lsize=1 => double height
+//Normal size: cursor is set once, glyphs are written as one run
 void oled_putstring(int col, int row, char *s, char lsize, int inv)
 {
     int c = col;
 	
-	while(*s)
+	if(!lsize)
 	{
-	    if(!lsize)
+		oled_gotoxy(col, row);
+		while(*s)
 		{
-	        oled_putchar1(c, row, *s++, inv);
+			oled_glyph(*s++, inv);
 		}
-        else
-        {
-            oled_putchar2(c, row, *s++, inv);
-		}	
-		c += (lsize + 1) * FONTW;
+		return;
+	}
+	
+	while(*s)
+	{
+        oled_putchar2(c, row, *s++, inv);
+		c += 2 * FONTW;
 	}
 }
 
 //Print an integer/long to OLED
 void oled_putnumber(int col, int row, long num, int dec, int lsize, int inv)
 {
-    char *s = malloc(16);
-	if(s != NULL)
-	{
-	    int2asc(num, dec, s, 16);
-	    oled_putstring(col, row, s, lsize, inv);
-	    free(s);
-	}	
+    char s[16];
+    
+    int2asc(num, dec, s, 16);
+    oled_putstring(col, row, s, lsize, inv);
 }
 
 
@@ -696,6 +1329,11 @@ void oled_drawbox(int x0, int y0, int x1, int y1)
 
 void draw_meter_scale(int meter_type)
 {
+	if(!widget_changed(W_SCALE, meter_type))
+	{
+		return;
+	}
+	
     if(!meter_type)
     {
         oled_putstring(0, 7, "S1 3 5 7 9 +10 +20dB", 0, 0);
@@ -713,71 +1351,77 @@ void draw_meter_scale(int meter_type)
 //
 ////////////////////////////////
 //INT 2 ASC
+//Digits are found by subtracting powers of ten (no division)
+//dec = number of digits behind decimal point (0 or -1 = none)
+//At most buflen - 1 characters plus the terminating 0 are written, a
+//longer number is cut off on the right
 int int2asc(long num, int dec, char *buf, int buflen)
 {
-    int i, c, xp = 0, neg = 0;
-    long n, dd = 1E09;
+    int c, len = 0, started = 0;
+    char d;
+    unsigned long n, p;
 
+    if(buflen < 1)
+    {
+        return 0;
+    }
+    buflen--; //Room for the terminating 0
+    
     if(!num)
 	{
-	    *buf++ = '0';
-		*buf = 0;
-		return 1;
+	    if(buflen)
+	    {
+	        buf[len++] = '0';
+	    }
+		buf[len] = 0;
+		return len;
 	}	
 		
     if(num < 0)
     {
-     	neg = 1;
-	    n = num * -1;
+	    if(len < buflen)
+	    {
+	        buf[len++] = '-';
+	    }
+	    n = -num;
     }
     else
     {
 	    n = num;
     }
 
-    //Fill buffer with \0
-    for(i = 0; i < 12; i++)
-    {
-	    *(buf + i) = 0;
-    }
-
-    c = 9; //Max. number of displayable digits
-    while(dd)
+    for(c = 9; c >= 0; c--) //Max. number of displayable digits
     {
-	    i = n / dd;
-	    n = n - i * dd;
-	
-	    *(buf + 9 - c + xp) = i + 48;
-	    dd /= 10;
+	    p = pgm_read_dword(&pow10tab[9 - c]);
+	    d = '0';
+	    while(n >= p)
+	    {
+		    n -= p;
+		    d++;
+	    }
+	    
+	    //Leading zeros are skipped
+	    if(d != '0')
+	    {
+		    started = 1;
+	    }
+	    if(started && len < buflen)
+	    {
+		    buf[len++] = d;
+	    }
+	    
 	    if(c == dec && dec)
 	    {
-	        *(buf + 9 - c + ++xp) = '.';
+	        if(len < buflen)
+	        {
+	            buf[len++] = '.';
+	        }
+	        started = 1;
 	    }
-	    c--;
-    }
-
-    //Search for 1st char different from '0'
-    i = 0;
-    while(*(buf + i) == 48)
-    {
-	    *(buf + i++) = 32;
     }
-
-    //Add minus-sign if neccessary
-    if(neg)
-    {
-	    *(buf + --i) = '-';
-    }
-
-    //Eleminate leading spaces
-    c = 0;
-    while(*(buf + i))
-    {
-	    *(buf + c++) = *(buf + i++);
-    }
-    *(buf + c) = 0;
+    buf[len] = 0;
 	
-	return c;
+	return len;
 }
 
 //STRLEN
@@ -795,52 +1439,186 @@ int strlen(char *s)
   // Data display functions //      
  //                        //
 ////////////////////////////
+//Status widgets: store value, return 1 if it differs from last value shown
+int widget_changed(int w, int val)
+{
+	if(widget_val[w] == val)
+	{
+		return 0;
+	}
+	widget_val[w] = val;
+	return 1;
+}
+
+//Screen has been cleared, all widgets must be drawn again
+void widget_invalidate(void)
+{
+	int t1;
+	
+	for(t1 = 0; t1 < WIDGETS; t1++)
+	{
+		widget_val[t1] = W_INVALID;
+	}
+}
+
+//Get and set one digit of BCD frequency counter (digit 0 = 1Hz)
+uint8_t freq_bcd_get(int n)
+{
+	if(n & 1)
+	{
+		return freq_bcd[n >> 1] >> 4;
+	}
+	return freq_bcd[n >> 1] & 0x0F;
+}
+
+void freq_bcd_put(int n, uint8_t d)
+{
+	if(n & 1)
+	{
+		freq_bcd[n >> 1] = (freq_bcd[n >> 1] & 0x0F) | (d << 4);
+	}
+	else
+	{
+		freq_bcd[n >> 1] = (freq_bcd[n >> 1] & 0xF0) | d;
+	}
+}
+
+//Load BCD counter from scratch (VFO swap, memory recall, big jumps)
+void freq_bcd_set(long f)
+{
+	int t1;
+	uint8_t d;
+	unsigned long n = f, p;
+	
+	freq_bcd_f = f;
+	for(t1 = FREQBCDDIGITS - 1; t1 >= 0; t1--)
+	{
+		p = pgm_read_dword(&pow10tab[9 - t1]);
+		d = 0;
+		while(n >= p)
+		{
+			n -= p;
+			d++;
+		}
+		freq_bcd_put(t1, d);
+	}
+}
+
+//Add tuning step to BCD counter digit by digit with carry/borrow
+//|delta| must be below FREQBCDMAXSTEP, result must stay positive
+void freq_bcd_add(long delta)
+{
+	uint8_t step[FREQBCDSTEPDIGITS];
+	int t1, d, c = 0, sign = 1;
+	unsigned long n, p;
+	
+	freq_bcd_f += delta;
+	if(delta < 0)
+	{
+		sign = -1;
+		n = -delta;
+	}
+	else
+	{
+		n = delta;
+	}
+	
+	//Split step into decimal digits (small number, max. 45 subtractions)
+	for(t1 = FREQBCDSTEPDIGITS - 1; t1 >= 0; t1--)
+	{
+		p = pgm_read_dword(&pow10tab[9 - t1]);
+		step[t1] = 0;
+		while(n >= p)
+		{
+			n -= p;
+			step[t1]++;
+		}
+	}
+	
+	//Ripple upwards only as long as there is something to add or carry
+	for(t1 = 0; t1 < FREQBCDDIGITS && (t1 < FREQBCDSTEPDIGITS || c); t1++)
+	{
+		d = freq_bcd_get(t1) + c;
+		if(t1 < FREQBCDSTEPDIGITS)
+		{
+			d += sign * step[t1];
+		}
+		
+		c = 0;
+		if(d > 9)
+		{
+			d -= 10;
+			c = 1;
+		}
+		else if(d < 0)
+		{
+			d += 10;
+			c = -1;
+		}
+		freq_bcd_put(t1, d);
+	}
+}
+
 //Current frequency (double letter height)
+//Tuning steps are added to the BCD counter, refresh or big jumps reload it
 void show_frequency(long f, int refresh)
 {
-	char *buf;
-	int t1 = 0;
+	char buf[FREQDIGITS];
+	int t1, t2 = 0, started = 0;
 	int ypos = 4;
+	uint8_t d;
+	long delta = f - freq_bcd_f;
 	
-	buf = malloc(10);
-	
-	//Init buffer string
-	for(t1 = 0; t1 < 10; t1++)
+	if(!f)
 	{
-	    *(buf + t1) = 0;
+		freq_bcd_f = 0;
 	}
-	
-	if(f)
+	else if(!refresh && freq_bcd_f && delta > -FREQBCDMAXSTEP && delta < FREQBCDMAXSTEP)
 	{
-	    int2asc(f / 10, 2, buf, 9);
+		freq_bcd_add(delta);
 	}
 	else
 	{
-		for(t1 = 0; t1 < 8; t1++)
+		freq_bcd_set(f);
+	}
+	
+	//Digits 10MHz...10Hz, leading zeros blanked
+	if(f)
+	{
+		for(t1 = FREQBCDDIGITS - 1; t1 >= 1; t1--)
 		{
-			buf[t1] = 32;
+			d = freq_bcd_get(t1);
+			if(d || t1 <= 3)
+			{
+				started = 1;
+			}
+			if(started)
+			{
+				buf[t2++] = d + '0';
+			}
+			if(t1 == 3)
+			{
+				buf[t2++] = '.';
+			}
 		}
-	}		
+	}
+	
+	//Pad with blanks to clear remains of a longer number
+	while(t2 < FREQDIGITS)
+	{
+		buf[t2++] = 32;
+	}
 	
 	//Display buffer (but only the letters that have changed)
-	for(t1 = 0; *(buf + t1); t1++)
+	//and copy it to digit cache
+	for(t1 = 0; t1 < FREQDIGITS; t1++)
 	{
-		if((*(oldbuf + t1) != *(buf + t1)) || refresh)
+		if(freq_digits[t1] != buf[t1] || refresh)
 		{
-		    oled_putchar2(15 + t1 * 12, ypos, *(buf + t1), 0);
+		    oled_putchar2(15 + t1 * 12, ypos, buf[t1], 0);
+		    freq_digits[t1] = buf[t1];
 		}   
 	}	
-	
-	//Copy current buffer to storing variable
-	t1 = 0;
-	while(*(buf + t1))
-	{
-		*(oldbuf + t1) = *(buf + t1);
-		t1++;
-	}	
-	
-	free(buf);
-
 }
 
 //VFO
@@ -848,6 +1626,11 @@ void show_vfo(int nvfo, int invert)
 {
 	int xpos = 0, ypos = 0;
 	
+	if(!widget_changed(W_VFO, (nvfo << 1) | invert))
+	{
+		return;
+	}
+	
 	oled_putstring(xpos * FONTWIDTH, ypos, "VFO:", 0, invert);			
 	oled_putchar1((xpos + 4) * 6, ypos, nvfo + 65, invert);  
 	
@@ -859,6 +1642,11 @@ void show_sideband(int sb, int invert)
 	int xpos = 6, ypos = 0;
 	char *sidebandstr[] = {"USB", "LSB"};
 	
+	if(!widget_changed(W_SIDEBAND, (sb << 1) | invert))
+	{
+		return;
+	}
+	
 	//Write string to position
 	oled_putstring(xpos * FONTWIDTH, ypos, sidebandstr[sb], 0, invert);
 }
@@ -869,51 +1657,57 @@ void show_txrx(int tr)
 	int xpos = 10, ypos = 0;
 	char *trstr[] = {"RX", "TX"};
 	
+	if(!widget_changed(W_TXRX, tr))
+	{
+		return;
+	}
+	
 	//Write string to position
 	oled_putstring(xpos * FONTWIDTH, ypos, trstr[tr], 0, tr);
 }
 
 void show_voltage(int v1)
 {
-    char *buffer;
-	int t1, p;
+    char buffer[16];
+	int p;
 	int xpos = 15, ypos = 0;
 		
-	buffer= malloc(0x10);
-	//Init buffer string
-	for(t1 = 0; t1 < 0x10; t1++)
+	if(!widget_changed(W_VOLTAGE, v1))
 	{
-	    *(buffer + t1) = 0;
+		return;
 	}
+	
     p = int2asc(v1, 1, buffer, 6) * 6;
     oled_putstring(xpos * 6, ypos, buffer, 0, 0);
 	oled_putstring(p + xpos * 6, ypos, "V ", 0, 0);
-	free(buffer);
 }
 
 void show_temp(int temperature)
 {
-    char *buffer;
-	int t1, p;
+    char buffer[16];
+	int p;
 	int xpos = 0, ypos = 1;
 		
-	buffer= malloc(0x10);
-	//Init buffer string
-	for(t1 = 0; t1 < 0x10; t1++)
+	if(!widget_changed(W_TEMP, temperature))
 	{
-	    *(buffer + t1) = 0;
+		return;
 	}
+	
     p = int2asc(temperature, -1, buffer, 6) * 6;
     oled_putstring(xpos * 6, ypos, buffer, 0, 0);
 	oled_putchar1(p + xpos * 6, ypos, 0x87, 0);
 	oled_putchar1(p + (xpos + 1) * 6, ypos, 'C', 0);
-	free(buffer);
 }
 
 void show_agc(int a, int invert)
 {
     int xpos = 10, ypos = 1;
 		
+	if(!widget_changed(W_AGC, (a << 1) | invert))
+	{
+		return;
+	}
+	
 	if(!a)
 	{	
         oled_putstring(xpos * FONTWIDTH, ypos, "AGC-S", 0, invert);
@@ -928,6 +1722,11 @@ void show_tone(int t, int invert)
 {
     int xpos = 5, ypos = 1;
 		
+	if(!widget_changed(W_TONE, (t << 1) | invert))
+	{
+		return;
+	}
+	
 	if(!t)
 	{	
         oled_putstring(xpos * FONTWIDTH, ypos, "LOW ", 0, invert);
@@ -942,6 +1741,11 @@ void show_mem_num(int n, int invert)
 {
     int xpos = 16, ypos = 1;
 		
+	if(!widget_changed(W_MEM, (n << 1) | invert))
+	{
+		return;
+	}
+	
 	oled_putstring(xpos++ * FONTWIDTH, ypos, "M", 0, invert);
 	if(n < 10)
 	{
@@ -955,6 +1759,11 @@ void show_split(int sp)
 {
     int xpos = 0, ypos = 2;
 		
+	if(!widget_changed(W_SPLIT, sp))
+	{
+		return;
+	}
+	
 	switch(sp)
 	{
 		case 0: oled_putstring(xpos * FONTWIDTH, ypos, "SPLT OFF", 0, 0);
@@ -967,7 +1776,7 @@ void show_split(int sp)
 //S-Meter bargraph (Page 6)
 void show_meter(int sv0)
 {
-    int sv;
+    int sv, peak;
 	sv = sv0;
 	
     if(sv > 120)
@@ -980,32 +1789,88 @@ void show_meter(int sv0)
 	    sv = 0;
 	}
 		
-    //Draw bar graph
-    oled_write_section(0, sv, 6, 0x1E);
-    oled_write_section(sv + 2, 128, 6, 0);
+    //Draw only the columns that differ from last bar graph
+    if(sv_old < 0) //Unknown, e.g. after screen clear
+    {
+        oled_write_section(0, sv, 6, 0x1E);
+        oled_write_section(sv, 128, 6, 0);
+    }
+    else if(sv > sv_old) //Grow
+    {
+        oled_write_section(sv_old, sv, 6, 0x1E);
+    }
+    else if(sv < sv_old) //Shrink
+    {
+        oled_write_section(sv, sv_old, 6, 0);
+    }
 	
-    sv_old = sv;
+    //Peak marker: one column behind the bar
+    cli();
+    peak = (peak_val >> 8) - 1;
+    sei();
     
-    if(sv > smax) //Get max value
+    if(peak_old != peak && peak_old >= sv && sv_old >= 0)
+    {
+		oled_write_section(peak_old, peak_old + 1, 6, 0); //Remove old marker
+	}
+	
+	if(peak >= sv)
 	{
-		smax = sv;
-		runseconds10s = runseconds10;
-	}	
+		oled_write_section(peak, peak + 1, 6, 0x1E);
+		peak_old = peak;
+	}
+	else
+	{
+		peak_old = -1; //Covered by bar
+	}		
+	
+    sv_old = sv;
 }
 
-//Reset max value of s meter
-void reset_smax(void)
+//Bar columns for ADC value 'x' of the S-meter or TX power slot
+int meter_cols(uint8_t slot, int x)
 {
-	int s = get_s_value();
+	if(slot == ADC_SLOT_PWR)
+	{
+		return x << 1;
+	}
+	return (x >> 2) + (x >> 3);
+}
+
+//Track peak of meter values, called from ADC_vect for every averaged
+//sample of the slot in peak_slot
+void meter_peak_sample(int sv)
+{
+	unsigned int v;
+	
+    if(sv > 120)
+	{
+	    sv = 120;
+	}
+	
+	if(sv < 0)
+	{
+	    sv = 0;
+	}
 	
-	s = (s / 3) * 3;
+	v = (unsigned int) sv << 8;
 	
-	//Clear bar graph
-	oled_write_section(0, 128, 6, 0);
-	smax = 0;	
-	sv_old = 0;
-	show_meter(s);
-}	
+	if(v >= peak_val)
+	{
+		peak_val = v;
+		peak_hold = PEAK_HOLD;
+	}
+}
+
+//Clear peak value on RX/TX change, peak follows TX power if 'tx' is set
+void meter_peak_reset(int tx)
+{
+	cli();
+	peak_slot = tx ? ADC_SLOT_PWR : ADC_SLOT_S;
+	peak_val = 0;
+	peak_hold = 0;
+	sei();
+}
 
 
     ////////////////////////
@@ -1016,84 +1881,315 @@ void reset_smax(void)
 void si5351_write(int reg_addr, int reg_value)
 {
    	 
-   twi_start();
-   twi_write(SI5351_ADDRESS);
-   twi_write(reg_addr);
-   twi_write(reg_value);
-   twi_stop();
+   si5351_ticket = twi_begin(SI5351_ADDRESS, 2);
+   twi_put(reg_addr);
+   twi_put(reg_value);
+   
+   si5351_bytes += 3;
+   si5351_transactions++;
 } 
 
+//Write 'number' consecutive registers in one transaction
+//(Si5351 increments register address automatically)
+void si5351_write_burst(int reg_addr, uint8_t *data, int number)
+{
+   int t1;
+   
+   si5351_ticket = twi_begin(SI5351_ADDRESS, number + 1);
+   twi_put(reg_addr);
+   for(t1 = 0; t1 < number; t1++)
+   {
+      twi_put(data[t1]);
+   }
+   
+   si5351_bytes += number + 2;
+   si5351_transactions++;
+}
+
+//Write an 8 byte PLL or multisynth block, but only the span
+//of registers that differs from the shadow copy
+void si5351_write_block(int reg_addr, uint8_t *data)
+{
+   int t1, first = 0, last = 7;
+   int block = (reg_addr - SYNTH_PLL_A) >> 3;
+   uint8_t *shadow = si5351_shadow + (reg_addr - SYNTH_PLL_A);
+   
+   if(si5351_shadow_valid & (1 << block))
+   {
+      while(first < 8 && data[first] == shadow[first])
+      {
+         first++;
+      }
+      
+      if(first == 8) //Nothing changed
+      {
+         return;
+      }
+      
+      while(data[last] == shadow[last])
+      {
+         last--;
+      }
+   }
+   
+   si5351_write_burst(reg_addr + first, data + first, last - first + 1);
+   
+   for(t1 = 0; t1 < 8; t1++)
+   {
+      shadow[t1] = data[t1];
+   }
+   si5351_shadow_valid |= (1 << block);
+}
+
+//Forget shadow contents, next write of each block is sent in full
+//Call after reset of chip or PLLs
+void si5351_invalidate(void)
+{
+   int t1;
+   
+   si5351_shadow_valid = 0;
+   for(t1 = 0; t1 < 3; t1++)
+   {
+      si5351_ms_f[t1] = 0;
+   }
+}
+
+//Numerator b = round(r0 * c / freq) for remainder r0 < freq
+//Returns CFACTOR if result rounds up to the next integer part
+unsigned long si5351_calc_b(unsigned long freq, unsigned long r0)
+{
+  unsigned long rm, q = 0;
+  long r2;
+  int t1;
+  
+  //Binary long division q = r0 * 2^20 / freq, rm = remainder
+  rm = r0;
+  for(t1 = 0; t1 < 20; t1++)
+  {
+    rm <<= 1;
+    q <<= 1;
+    if(rm >= freq)
+    {
+      rm -= freq;
+      q |= 1;
+    }
+  }
+  
+  //b = round(r0 * (2^20 - 1) / freq) = q + (rm - r0 + freq/2) / freq
+  r2 = (long) rm - (long) r0 + (long) (freq >> 1);
+  if(r2 < 0)
+  {
+    q--;
+  }
+  else if(r2 >= (long) freq)
+  {
+    q++;
+  }
+  
+  return q;
+}
+
+//Division factor fvco/freq = a + b/c with c = CFACTOR, integer only
+//b is rounded to the nearest 1/c, so result is the closest frequency
+//possible with this c (error < 0.3 Hz at 23 MHz)
+//Keeps a and remainder of last frequency of each multisynth,
+//for freq = f_old + d the new remainder is r_old - a * d.
+//Division fvco/freq only if integer part a changes or step is large
+void si5351_calc_div_step(int ms, unsigned long freq, unsigned long *a, unsigned long *b)
+{
+  unsigned long fvco = (unsigned long) F_XTAL * PLLRATIO;
+  long d = (long) freq - (long) si5351_ms_f[ms];
+  long r = -1;
+  
+  if(si5351_ms_f[ms] && d > -SI5351_MAXSTEP && d < SI5351_MAXSTEP)
+  {
+    r = (long) si5351_ms_r[ms] - (long) si5351_ms_a[ms] * d;
+  }
+  
+  if(r < 0 || r >= (long) freq) //Integer part has changed => full calculation
+  {
+    si5351_ms_a[ms] = fvco / freq;
+    r = fvco - si5351_ms_a[ms] * freq;
+  }
+  si5351_ms_f[ms] = freq;
+  si5351_ms_r[ms] = r;
+  
+  *a = si5351_ms_a[ms];
+  *b = si5351_calc_b(freq, r);
+  
+  if(*b >= CFACTOR) //Rounded up to next integer
+  {
+    (*a)++;
+    *b = 0;
+  }
+}
+
+//Convert a + b/c (c = CFACTOR) to register parameters P1 and P2 (AN619)
+//128 * b / c is calculated without division because c = 2^20 - 1
+void si5351_calc_p(unsigned long a, unsigned long b, unsigned long *p1, unsigned long *p2)
+{
+  unsigned long t = b << 7;  //128 * b
+  unsigned long q = t >> 20; //floor(128 * b / c) or one less
+  unsigned long rm = (t & 0xFFFFF) + q; //t - q * c
+  
+  if(rm >= CFACTOR)
+  {
+    q++;
+    rm -= CFACTOR;
+  }
+  
+  *p1 = 128 * a + q - 512;
+  *p2 = rm;
+}
+
+//Split P1, P2 and P3 into the 8 byte register block of a PLL or multisynth
+void si5351_pack_regs(uint8_t *regs, unsigned long p1, unsigned long p2, unsigned long p3)
+{
+  regs[0] = (p3 & 0x0000FF00) >> 8;
+  regs[1] = (p3 & 0x000000FF);
+  regs[2] = (p1 & 0x00030000) >> 16;
+  regs[3] = (p1 & 0x0000FF00) >> 8;
+  regs[4] = (p1 & 0x000000FF);
+  regs[5] = ((p3 & 0x000F0000) >> 12) | ((p2 & 0x000F0000) >> 16);
+  regs[6] = (p2 & 0x0000FF00) >> 8;
+  regs[7] = (p2 & 0x000000FF);
+}
+
 // Set PLLs (VCOs) to internal clock rate of 900 MHz
 // Equation fVCO = fXTAL * (a+b/c) (=> AN619 p. 3
 void si5351_start(void)
 {
-  unsigned long a, b, c;
   unsigned long p1, p2;//, p3;
+  uint8_t regs[8];
     
   // Init clock chip
   si5351_write(XTAL_LOAD_CAP, 0xD2);      // Set crystal load capacitor to 10pF (default), 
                                           // for bits 5:0 see also AN619 p. 60
   si5351_write(CLK_ENABLE_CONTROL, 0x00); // Enable all outputs
+#if (SYNTHOPTION == 0)
   si5351_write(CLK0_CONTROL, 0x0F);       // Set PLLA to CLK0, 8 mA output
   si5351_write(CLK1_CONTROL, 0x2F);       // Set PLLB to CLK1, 8 mA output
+#else
+  si5351_write(CLK0_CONTROL, 0x4F);       // Set PLLA to CLK0, 8 mA output, MS0 integer mode
+  si5351_write(CLK1_CONTROL, 0x6F);       // Set PLLB to CLK1, 8 mA output, MS1 integer mode
+#endif
   si5351_write(CLK2_CONTROL, 0x2F);       // Set PLLB to CLK2, 8 mA output
   si5351_write(PLL_RESET, 0xA0);          // Reset PLLA and PLLB
+  si5351_invalidate();
 
   // Set VCOs of PLLA and PLLB to 650 MHz
-  a = PLLRATIO;     // Division factor 650/25 MHz !!!!
-  b = 0;            // Numerator, sets b/c=0
-  c = CFACTOR;      //Max. resolution, but irrelevant in this case (b=0)
-
-  //Formula for splitting up the numbers to register data, see AN619
-  p1 = 128 * a + (unsigned long) (128 * b / c) - 512;
-  p2 = 128 * b - c * (unsigned long) (128 * b / c);
-  //p3  = c;
+  // a = PLLRATIO, b = 0 (b/c=0), c = CFACTOR
+  si5351_calc_p(PLLRATIO, 0, &p1, &p2);
   
   //Write data to registers PLLA and PLLB so that both VCOs are set to 900MHz intermal freq
-  si5351_write(SYNTH_PLL_A, 0xFF);
-  si5351_write(SYNTH_PLL_A + 1, 0xFF);
-  si5351_write(SYNTH_PLL_A + 2, (p1 & 0x00030000) >> 16);
-  si5351_write(SYNTH_PLL_A + 3, (p1 & 0x0000FF00) >> 8);
-  si5351_write(SYNTH_PLL_A + 4, (p1 & 0x000000FF));
-  si5351_write(SYNTH_PLL_A + 5, 0xF0 | ((p2 & 0x000F0000) >> 16));
-  si5351_write(SYNTH_PLL_A + 6, (p2 & 0x0000FF00) >> 8);
-  si5351_write(SYNTH_PLL_A + 7, (p2 & 0x000000FF));
-
-  si5351_write(SYNTH_PLL_B, 0xFF);
-  si5351_write(SYNTH_PLL_B + 1, 0xFF);
-  si5351_write(SYNTH_PLL_B + 2, (p1 & 0x00030000) >> 16);
-  si5351_write(SYNTH_PLL_B + 3, (p1 & 0x0000FF00) >> 8);
-  si5351_write(SYNTH_PLL_B + 4, (p1 & 0x000000FF));
-  si5351_write(SYNTH_PLL_B + 5, 0xF0 | ((p2 & 0x000F0000) >> 16));
-  si5351_write(SYNTH_PLL_B + 6, (p2 & 0x0000FF00) >> 8);
-  si5351_write(SYNTH_PLL_B + 7, (p2 & 0x000000FF));
-
+  si5351_pack_regs(regs, p1, p2, CFACTOR);
+  si5351_write_block(SYNTH_PLL_A, regs);
+  si5351_write_block(SYNTH_PLL_B, regs);
+
+#if (SYNTHOPTION == 1)
+  //Fixed even dividers for LO and VFO range, see si5351_plan_div()
+  si5351_set_ms_int(SYNTH_MS_0, si5351_plan_div(F_LO_LSB - 10000, F_LO_USB + 10000));
+  si5351_set_ms_int(SYNTH_MS_1, si5351_plan_div(13999990 + INTERFREQUENCY, 14400000 + INTERFREQUENCY));
+  si5351_write(PLL_RESET, 0xA0);          // Reset PLLs with the first plan
+#endif
 }
 
+#if (SYNTHOPTION == 0)
 void si5351_set_freq(int synth, unsigned long freq)
 {
-  unsigned long  a, b, c = CFACTOR; 
-  unsigned long f_xtal = 25000000;
-  double fdiv = (double) (f_xtal * PLLRATIO) / freq; //division factor fvco/freq (will be integer part of a+b/c)
-  double rm; //remainder
+  unsigned long a, b; 
   unsigned long p1, p2;
+  uint8_t regs[8];
   
-  a = (unsigned long) fdiv;
-  rm = fdiv - a;  //(equiv. to fractional part b/c)
-  b = rm * c;
-  p1  = 128 * a + (unsigned long) (128 * b / c) - 512;
-  p2 = 128 * b - c * (unsigned long) (128 * b / c);
+  si5351_calc_div_step((synth - SYNTH_MS_0) >> 3, freq, &a, &b); //division factor fvco/freq = a+b/c
+  si5351_calc_p(a, b, &p1, &p2);
       
-  //Write data to multisynth registers of synth n
-  si5351_write(synth, 0xFF);      //1048575 MSB
-  si5351_write(synth + 1, 0xFF);  //1048575 LSB
-  si5351_write(synth + 2, (p1 & 0x00030000) >> 16);
-  si5351_write(synth + 3, (p1 & 0x0000FF00) >> 8);
-  si5351_write(synth + 4, (p1 & 0x000000FF));
-  si5351_write(synth + 5, 0xF0 | ((p2 & 0x000F0000) >> 16));
-  si5351_write(synth + 6, (p2 & 0x0000FF00) >> 8);
-  si5351_write(synth + 7, (p2 & 0x000000FF));
+  //Write changed data to multisynth registers of synth n (one transaction)
+  si5351_pack_regs(regs, p1, p2, CFACTOR);
+  si5351_write_block(synth, regs);
+}
+#endif
+
+#if (SYNTHOPTION == 1)
+//Largest even integer divider n so that VCO = n * f stays
+//within 600...900 MHz for all f in fmin...fmax
+//Returns 0 if there is no such divider
+unsigned long si5351_plan_div(unsigned long fmin, unsigned long fmax)
+{
+  unsigned long n = (SI5351_VCO_MAX / fmax) & ~1UL;
+  
+  if(n > 1800)
+  {
+    n = 1800;
+  }
+  
+  if(n < 6 || n * fmin < SI5351_VCO_MIN)
+  {
+    return 0;
+  }
+  return n;
+}
+
+//Set multisynth to even integer division n (P1 = 128 * n - 512, P2 = 0, P3 = 1)
+//n = 0 (no plan) leaves the multisynth unset
+void si5351_set_ms_int(int synth, unsigned long n)
+{
+  uint8_t regs[8];
+  
+  if(!n)
+  {
+    return;
+  }
+  si5351_ms_n[(synth - SYNTH_MS_0) >> 3] = n;
+  si5351_pack_regs(regs, 128 * n - 512, 0, 1);
+  si5351_write_block(synth, regs);
+}
+
+//Multisynth is fixed (integer), frequency is set by PLL: fvco = n * freq
+//MS0 is driven by PLLA, MS1 and MS2 by PLLB
+void si5351_set_freq(int synth, unsigned long freq)
+{
+  int ms = (synth - SYNTH_MS_0) >> 3;
+  unsigned long n = si5351_ms_n[ms];
+  unsigned long fvco, a, b; 
+  unsigned long p1, p2;
+  uint8_t regs[8];
+  int replan = 0;
+  
+  //Frequency outside of planned range => new divider with 12% headroom
+  //(compared as freq against VCO / n, n * freq may not fit 32 bit)
+  if(!n || freq > SI5351_VCO_MAX / n || freq < (SI5351_VCO_MIN + n - 1) / n)
+  {
+    n = si5351_plan_div(freq - (freq >> 3), freq + (freq >> 3));
+    if(!n) //No even divider for this frequency: keep previous plan
+    {
+      return;
+    }
+    si5351_set_ms_int(synth, n);
+    replan = 1;
+  }
+  
+  //PLL ratio fvco/fxtal = a + b/c
+  fvco = n * freq;
+  a = fvco / F_XTAL;
+  b = si5351_calc_b(F_XTAL, fvco - a * F_XTAL);
+  if(b >= CFACTOR)
+  {
+    a++;
+    b = 0;
+  }
+  si5351_calc_p(a, b, &p1, &p2);
+  
+  //Write changed data to PLL registers (one transaction)
+  si5351_pack_regs(regs, p1, p2, CFACTOR);
+  si5351_write_block(ms ? SYNTH_PLL_B : SYNTH_PLL_A, regs);
+  
+  if(replan)
+  {
+    si5351_write(PLL_RESET, 0xA0);
+  }
 }
+#endif
 
     //////////////////////////////
    //                          // 
@@ -1112,6 +2208,40 @@ void set_lo_frequency(long f)
 void set_vfo_frequency(long f)
 {
     si5351_set_freq(SYNTH_MS_1, f);	
+    f_synth = f;
+}
+
+//Tuning part of the main loop, tx = 1 locks the VFO while transmitting.
+//Encoder only moves the target frequency, Si5351 and display follow
+//without waiting for the bus. Returns detents taken.
+int tune_vfo(int tx)
+{
+	int knob = encoder_detents();
+	
+	if(knob && !tx)  
+	{    
+	    f_vfo[cur_vfo] += (long) knob * calc_tuningfactor();  
+#if (LATENCYSTATS == 1)
+	    lat_start();
+#endif
+	}
+	
+	//Si5351 gets newest target as soon as its last write has left the bus,
+	//frequencies in between are skipped; the queue has room for it, so
+	//the loop never waits for the bus
+	if(f_vfo[cur_vfo] + INTERFREQUENCY != f_synth && twi_passed(si5351_ticket) && twi_room() >= SI5351_QUEUE)
+	{
+	    set_vfo_frequency(f_vfo[cur_vfo] + INTERFREQUENCY);
+	}
+	
+	//Display renders newest target into frame buffer once the last one
+	//has been flushed (pages 4 and 5), so it never shows a mix of both
+	if(f_vfo[cur_vfo] != freq_bcd_f && oled_dx0[4] >= oled_dx1[4] && oled_dx0[5] >= oled_dx1[5])
+	{
+		show_frequency(f_vfo[cur_vfo], 0);
+	}
+	
+	return tx ? 0 : knob;
 }
 
   ///////////
@@ -1119,10 +2249,12 @@ void set_vfo_frequency(long f)
 ///////////
 void adj_lo_frequency(int sb)
 {
+	int knob;
 	int key = 0;
 		
     //LO FREQ USB or LSB
 	key = 0;	
+	oled_cls(0);
 	show_frequency(f_lo[sb], 1); 
 	if(!sb)
 	{
@@ -1138,22 +2270,22 @@ void adj_lo_frequency(int sb)
 	
 	while(!key)
 	{
-		if(tuningknob < -2)  
+		knob = encoder_take(2);
+		if(knob < 0)  
 		{    
 		    f_lo[sb] += 10;
-		    tuningknob = 0;
 			show_frequency(f_lo[sb], 0);
 			set_lo_frequency(f_lo[sb]);
 		}	
 		
-		if(tuningknob > 2)  
+		if(knob > 0)  
 		{    
 		    f_lo[sb] -= 10;
-			tuningknob = 0;
 			show_frequency(f_lo[sb], 0);
 			set_lo_frequency(f_lo[sb]);
 		}	
 		
+	    oled_flush();
 	    key = get_keys();    
 	}	
 	
@@ -1170,6 +2302,7 @@ int scan_memories(int thresh)
         
     while(get_keys());
     
+    oled_cls(0);
     oled_putstring(0, 0, "SCAN MEMORIES", 0, 0);
     
     while(!key)
@@ -1180,10 +2313,12 @@ int scan_memories(int thresh)
 		{
 			show_frequency(f_tmp, 1);
 			set_vfo_frequency(f_tmp + INTERFREQUENCY);
+			adc_wait_sample();
 			runseconds10_scan = runseconds10;
 			while(runseconds10_scan + 50 > runseconds10 && !key)
 			{
 				oled_putnumber(0, 7, 5 - (runseconds10 - runseconds10_scan) / 10, -1, 0, 0);;
+				oled_flush();
 				key = get_keys();
 				sval = get_s_value();
 				show_meter(sval);	
@@ -1193,6 +2328,7 @@ int scan_memories(int thresh)
 				    {
 					    sval = get_s_value();
 		                show_meter(sval);
+		                oled_flush();
 		                key = get_keys();
 		            }    
 		        } 
@@ -1230,6 +2366,7 @@ long scan_vfo(int thresh)
 	
 	while(get_keys());
 	
+	oled_cls(0);
 	oled_putstring(0, 0, "SCAN VFOA > VFOB", 0, 0);
 	
 	if(f0 > f1)
@@ -1249,6 +2386,7 @@ long scan_vfo(int thresh)
 	    {	
 		    set_vfo_frequency(f_tmp + INTERFREQUENCY);
 		    show_frequency(f_tmp, 0);	
+		    adc_wait_sample();
 		    sval = get_s_value();
 		    show_meter(sval);
 		    
@@ -1258,10 +2396,12 @@ long scan_vfo(int thresh)
 				{
 					sval = get_s_value();
 		            show_meter(sval);
+		            oled_flush();
 		            key = get_keys();
 		        }    
 		    }        
 	    	
+	        oled_flush();
 	        key = get_keys();
 	        if(key == 2)
 	        {
@@ -1276,11 +2416,13 @@ long scan_vfo(int thresh)
 //Define S-Value where scnanning halts
 int set_scan_threshold(int cur_thresh)
 {
+	int knob;
 	int key = 0;
 	int l_thresh =  cur_thresh;
 	
 	while(get_keys());
 	
+	oled_cls(0);
 	oled_putstring(0, 0, "SCAN THRESH", 0, 0);
 	//Draw bar graph
     oled_write_section(0, l_thresh, 6, 0x1E);
@@ -1289,7 +2431,10 @@ int set_scan_threshold(int cur_thresh)
     
 	while(!get_keys())
 	{
-		if(tuningknob < -2)  
+		oled_flush();
+		
+		knob = encoder_take(2);
+		if(knob < 0)  
 		{    
 		    if(l_thresh < 100)
 		    {
@@ -1299,10 +2444,9 @@ int set_scan_threshold(int cur_thresh)
                 oled_write_section(l_thresh, 128, 6, 0);
                 oled_putnumber(2 * FONTWIDTH, 4, l_thresh, -1, 0, 0);
 			}		 
-			tuningknob = 0;
 		}	
 		
-		if(tuningknob > 2)  
+		if(knob > 0)  
 		{    
 		    if(l_thresh > 0)
 		    {
@@ -1312,9 +2456,9 @@ int set_scan_threshold(int cur_thresh)
                 oled_write_section(l_thresh, 128, 6, 0);
                 oled_putnumber(2 * FONTWIDTH, 4, l_thresh, -1, 0, 0);
 			}		 
-			tuningknob = 0;
 		}	
 		
+	    oled_flush();
 	    key = get_keys();    
 	    
 	    if(key == 2)
@@ -1327,9 +2471,22 @@ int set_scan_threshold(int cur_thresh)
 }	
 
 //Calc increment/decrement rate from tuning speed
+//Hz per detent from smoothed encoder speed and acceleration curve
 int calc_tuningfactor(void)
 {
-	return (tuningcount * tuningcount * -1); //-1 reverses tuning direction
+	uint16_t dt;
+	int t1 = 0;
+	
+	cli();
+	dt = enc_dt;
+	sei();
+	
+	while(dt < pgm_read_word(&enc_curve[t1][0]))
+	{
+		t1++;
+	}
+	
+	return -(int) pgm_read_word(&enc_curve[t1][1]); //-1 reverses tuning direction
 }	
 
   /////////////////
@@ -1372,7 +2529,7 @@ void store_frequency(long f, int vfo, int memory)
     long hiword, loword;
     unsigned char hmsb, lmsb, hlsb, llsb;
 	
-    int start_adr =0;
+    uintptr_t start_adr = 0; //EEPROM address
     
     if(memory == -1)
     {
@@ -1413,7 +2570,7 @@ long load_frequency(int vfo, int memory)
 {
     long rf;
     unsigned char hmsb, lmsb, hlsb, llsb;
-    int start_adr =0;
+    uintptr_t start_adr = 0; //EEPROM address
     
     if(memory == -1)
     {
@@ -1453,7 +2610,7 @@ int is_mem_freq_ok(long f)
 //Store last VFO used
 void store_last_vfo(int vfonum)
 {
-    int start_adr = 8;
+    uintptr_t start_adr = 8; //EEPROM address
     
 	cli();
     
@@ -1466,7 +2623,7 @@ void store_last_vfo(int vfonum)
 //Store last VFO stored
 int load_last_vfo(void)
 {
-    int start_adr = 8;
+    uintptr_t start_adr = 8; //EEPROM address
     int vfonum;
     
     cli();
@@ -1622,35 +2779,114 @@ int get_keys(void)
 //
 /////////////////////
 //Read ADC value
-int get_adc(int adc_channel)
+//Start free running scan of all ADC channels
+void adc_init(void)
 {
+	uint8_t front;
+	int t1;
 	
-	int adc_val = 0;
+	ADMUX = (1<<REFS0) | pgm_read_byte(&adc_chan[0]);
+	ADCSRB = (1<<ADTS1) | (1<<ADTS0); //Auto trigger by timer 0 compare match A
+	//Prescaler 128: 125 kHz ADC clock (max. 200 kHz for 10 bit), 104 us
+	//per conversion, well within the 500 us between two triggers
+	ADCSRA = (1<<ADPS0) | (1<<ADPS1) | (1<<ADPS2) | (1<<ADEN) | (1<<ADATE) | (1<<ADIE); //Prescaler 128 and ADC on
 	
-	ADMUX = (1<<REFS0) + adc_channel;     // Kanal adcmode aktivieren
-    _delay_ms(1);
+	TCCR0A = (1<<WGM01);              //Timer 0 CTC mode
+	OCR0A = ADC_TIMER_TOP;
+	TCCR0B = (1<<CS01) | (1<<CS00);   //Prescaler 64
 	
-    ADCSRA |= (1<<ADSC);
-    
-	_delay_ms(1);
+	//Wait for first complete round and start filters from there
+	front = adc_front;
+	while(adc_front == front);
+	
+	cli();
+	for(t1 = 0; t1 < ADC_CHANNELS; t1++)
+	{
+		adc_filt[t1] = adc_res[adc_front][t1] << ADC_FRAC;
+	}
+	sei();
+}
+
+//One step of IIR lowpass: s += (x - s) / 2^k, k depends on direction
+//s has ADC_FRAC fractional bits, x is a 10 bit ADC value
+int16_t adc_iir(int16_t s, uint16_t x, uint8_t idx)
+{
+	int16_t d = (int16_t) (x << ADC_FRAC) - s;
+	uint8_t k;
+	
+	if(d > 0)
+	{
+		k = pgm_read_byte(&adc_attack[idx]);
+	}
+	else
+	{
+		k = pgm_read_byte(&adc_decay[idx]);
+	}
+	
+	return s + (d >> k);
+}
+
+//Reading of an ADC channel, no waiting
+//ADC_RAW: last conversion, ADC_SMOOTH: oversampled and filtered
+//(peaks of the meter are taken in ADC_vect, see meter_peak_sample())
+int get_adc_val(int adc_channel, int mode)
+{
+	int t1, adc_val = 0;
 	
-	adc_val = ADCL;
-    adc_val += ADCH * 256;   
+	for(t1 = 0; t1 < ADC_CHANNELS; t1++)
+	{
+		if(pgm_read_byte(&adc_chan[t1]) == adc_channel)
+		{
+			cli();
+			switch(mode)
+			{
+				case ADC_RAW:    adc_val = adc_res[adc_front][t1];
+				                 break;
+				case ADC_SMOOTH: adc_val = (adc_filt[t1] + (1 << (ADC_FRAC - 1))) >> ADC_FRAC;
+				                 break;
+			}
+			sei();
+			break;
+		}
+	}
 	
 	return adc_val;
+}	
+
+//Wait until the last Si5351 write has left the bus and a filtered
+//sample has been taken from conversions after it (up to 8 rounds, 20 ms).
+//Scans compare the S-meter of the new frequency, not of one before.
+void adc_wait_sample(void)
+{
+	uint8_t r;
 	
+	while(!twi_passed(si5351_ticket));
+	r = (adc_round | (ADC_OVERSAMPLE - 1)) + 1; //Next block of rounds
+	while(adc_round != (uint8_t) (r + ADC_OVERSAMPLE));
+}	
+
+//Latest conversion of an ADC channel
+int get_adc(int adc_channel)
+{
+	return get_adc_val(adc_channel, ADC_RAW);
 }	
 
 int get_s_value(void)
 {
+	int sv;
+	
 	//oled_putnumber(0, 0, get_adc(1), -1, 0, 0);
-	return ((get_adc(1) >> 2) + (get_adc(1) >> 3));
+	sv = get_adc_val(1, ADC_SMOOTH);
+	return meter_cols(ADC_SLOT_S, sv);
 }	
 
 int get_tx_pwr_value(void)
 {
+	int pwr;
+	
 	//oled_putnumber(0, 0, get_adc(3), -1, 0, 0);
-	return (get_adc(3) << 1);
+	pwr = get_adc_val(3, ADC_SMOOTH);
+	return meter_cols(ADC_SLOT_PWR, pwr);
 }	
 
 int get_txrx(void)
@@ -1667,12 +2903,28 @@ int get_txrx(void)
 
 int get_temp(void)
 {
-	int adc = get_adc(6);
-	double ux = (double) (5 * adc) / 1023;
-    double rx = 3000 / (5 / ux - 1);
-	double temp = (rx - 1630) / 17.62;
+	return adc2temp(get_adc_val(6, ADC_SMOOTH));
+}	
+
+//PA temperature in deg. C: sensor resistance rx in a divider with 3k0,
+//1630 Ohm at 0 deg. C, 17.62 Ohm/K (integer math, no float library)
+int adc2temp(int adc)
+{
+	long temp;
 	
-	return (int) temp;
+	if(adc > 1022) //Sensor open
+	{
+		adc = 1022;
+	}
+	temp = (300000L * adc / (1023 - adc) - 163000) / 1762; //rx in 0.01 Ohm
+	
+	return (temp > 999) ? 999 : (int) temp; //Fits into 16 bit and the display
+}	
+
+//Supply voltage in 0.1 V: divider 1:5, 5 V reference
+int adc2volt(int adc)
+{
+	return (int) (((long) adc * 250) >> 10);
 }	
 
   //////////
@@ -1694,17 +2946,19 @@ void print_menu_item(char *m_str, int ypos, int inverted)
 	oled_putstring(xpos1  * FONTWIDTH, ypos + 1, m_str, 0, inverted);
 }
 	
+//Menu strings, kept in flash to save RAM
+const char menu_str[6][5][9] PROGMEM = {{"VFO SWAP", "VFO B=A ", "VFO A=B ", "VFO>MEM ", "MEM>VFO "}, 
+		                                {"USB     ", "LSB     ", "        ", "        "},
+		                                {"TONE LO ", "TONE HI ", "AGC SLO ", "AGC FST "},
+		                                {"MEMORY  ", "VFOs    ", "THRESH  ", "        "},
+		                                {"SPLT OFF", "SPLT ON ", "        ", "        "},
+		                                {"SET USB ", "SET LSB ", "        ", "        "}};
+		                                
 //Print the itemlist or single item
 void print_menu_item_list(int m, int item, int invert)
 {
 	int menu_items[] =  MENUITEMS; 
-	
-	char *menu_str[6][5] =    {{"VFO SWAP", "VFO B=A ", "VFO A=B ", "VFO>MEM ", "MEM>VFO "}, 
-		                       {"USB     ", "LSB     ", "        ", "        "},
-		                       {"TONE LO ", "TONE HI ", "AGC SLO ", "AGC FST "},
-		                       {"MEMORY  ", "VFOs    ", "THRESH  ", "        "},
-		                       {"SPLT OFF", "SPLT ON ", "        ", "        "},
-		                       {"SET USB ", "SET LSB ", "        ", "        "}};
+	char buf[9];
     int t1;
     
     if(item == -1)
@@ -1712,18 +2966,24 @@ void print_menu_item_list(int m, int item, int invert)
         //Print item list for menu
 	    for(t1 = 0; t1 < menu_items[m] + 1; t1++)
 	    {
-		    print_menu_item(menu_str[m][t1], t1, 0);   
+		    print_menu_item_list(m, t1, 0);   
 	    }	
 	}
 	else	
 	{
-		print_menu_item(menu_str[m][item], item, invert);   
+		//Copy menu string from flash
+		for(t1 = 0; t1 < 9; t1++)
+		{
+			buf[t1] = pgm_read_byte(&menu_str[m][item][t1]);
+		}	
+		print_menu_item(buf, item, invert);   
 	}	
 }
 
 //Returns menu_pos if OK or -1 if aborted
 int navigate_thru_item_list(int m, int maxitems)
 {
+	int knob;
 	int menu_pos = 0, menu_pos_old = -1;
 	
 	print_menu_item_list(m, menu_pos, 1)   ;     //Write 1st entry in normal color
@@ -1732,7 +2992,8 @@ int navigate_thru_item_list(int m, int maxitems)
 	
     while(key == 0)
 	{
-		if(tuningknob < -2) //Turn CW
+		knob = encoder_take(2);
+		if(knob < 0) //Turn CW
 		{
 			print_menu_item_list(m, menu_pos, 0); //Write old entry in normal color
 		    if(menu_pos < maxitems)
@@ -1744,10 +3005,9 @@ int navigate_thru_item_list(int m, int maxitems)
 				menu_pos = 0;
 			}
 			print_menu_item_list(m, menu_pos, 1); //Write new entry in reverse color
-		    tuningknob = 0;
 		}
 
-		if(tuningknob > 2)  //Turn CCW
+		if(knob > 0)  //Turn CCW
 		{    
 		    print_menu_item_list(m, menu_pos, 0); //Write old entry in normal color
 		    if(menu_pos > 0)
@@ -1759,7 +3019,6 @@ int navigate_thru_item_list(int m, int maxitems)
 				menu_pos = maxitems;
 			}
 			print_menu_item_list(m, menu_pos, 1); //Write new entry in reverse color
-		    tuningknob = 0;
 		}		
 		
 		//Preview of certain settings
@@ -1776,6 +3035,7 @@ int navigate_thru_item_list(int m, int maxitems)
 			}	         
 			menu_pos_old = menu_pos;
 		}		
+		oled_flush();
 		key = get_keys();
 	}
 		
@@ -1832,6 +3092,7 @@ void show_mem_menu_item(int m_item, int inv)
 
 int mem_select(int c_mem, int smode)
 {
+	int knob;
 	int t1;
 	int key = 0;
 	int c = c_mem;
@@ -1865,11 +3126,13 @@ int mem_select(int c_mem, int smode)
 		show_mem_menu_item(t1, inv);
 	}	
 	
+	oled_flush();
 	key = get_keys();
 	show_mem_menu_item(c_mem, 1);
 	while(!key)
 	{
-		if(tuningknob < -2) //Turn CW
+		knob = encoder_take(2);
+		if(knob < 0) //Turn CW
 		{
 			show_mem_menu_item(c, 0);
 		    
@@ -1882,10 +3145,9 @@ int mem_select(int c_mem, int smode)
 				c = 0;
 			}
 			show_mem_menu_item(c, 1);
-		    tuningknob = 0;
 		}
 
-		if(tuningknob > 2)  //Turn CCW
+		if(knob > 0)  //Turn CCW
 		{    
 		    show_mem_menu_item(c, 0);
 		    
@@ -1899,8 +3161,8 @@ int mem_select(int c_mem, int smode)
 			}
 			show_mem_menu_item(c, 1);
 		    
-		    tuningknob = 0;
 		}		
+		oled_flush();
 		key = get_keys();
 	}	
 	
@@ -2061,6 +3323,115 @@ long menux(long f, int c_vfo)
 	return -2; //Nothing to do in main()
 }
 
+#if (LATENCYSTATS == 1)
+  ////////////////////////////
+ //  LATENCY STATISTICS    //
+////////////////////////////
+//Start measuring at the encoder edge that moved the target frequency,
+//stage 0 (tuning logic) is done right now
+void lat_start(void)
+{
+	if(!lat_pending)
+	{
+		cli();
+		lat_t0 = enc_time;
+		sei();
+		lat_pending = (1 << LAT_STAGES) - 1;
+		lat_record(0);
+	}
+}
+
+//Called once per main loop pass with the current target frequency
+void lat_check(long f)
+{
+	if(!lat_pending)
+	{
+		return;
+	}
+	
+	if((uint16_t) (get_ticks() - lat_t0) > LAT_TIMEOUT)
+	{
+		lat_pending = 0;
+		return;
+	}
+	
+	//Si5351 has been set to target and last byte has left the bus
+	if((lat_pending & 2) && f + INTERFREQUENCY == f_synth && twi_passed(si5351_ticket))
+	{
+		lat_record(1);
+	}
+	
+	//Target is in frame buffer and frequency pages have been sent
+	if((lat_pending & 4) && f == freq_bcd_f && oled_dx0[4] >= oled_dx1[4] && oled_dx0[5] >= oled_dx1[5] && twi_passed(oled_ticket))
+	{
+		lat_record(2);
+	}
+}
+
+//Count time since encoder edge in log2 bucket of stage
+void lat_record(int stage)
+{
+	uint16_t dt = get_ticks() - lat_t0;
+	int b = 0;
+	
+	while(dt > 1 && b < LAT_BUCKETS - 1)
+	{
+		dt >>= 1;
+		b++;
+	}
+	
+	if(lat_hist[stage][b] < 0xFFFF)
+	{
+		lat_hist[stage][b]++;
+	}
+	lat_pending &= ~(1 << stage);
+}
+
+//Debug screen: per stage name, number of samples and bar graph of buckets
+void lat_show(void)
+{
+	int s, b, h;
+	uint16_t max;
+	long n;
+	
+	oled_cls(0);
+	for(s = 0; s < LAT_STAGES; s++)
+	{
+		max = 1;
+		n = 0;
+		for(b = 0; b < LAT_BUCKETS; b++)
+		{
+			n += lat_hist[s][b];
+			if(lat_hist[s][b] > max)
+			{
+				max = lat_hist[s][b];
+			}
+		}
+		oled_putstring(0, s * 2, lat_name[s], 0, 0);
+		oled_putnumber(8 * FONTWIDTH, s * 2, n, -1, 0, 0);
+		
+		//8 columns per bucket, height 1...8 pixels
+		for(b = 0; b < LAT_BUCKETS; b++)
+		{
+			if(lat_hist[s][b])
+			{
+				h = ((long) lat_hist[s][b] * 7) / max + 1;
+				oled_fill(b * 8, b * 8 + 7, s * 2 + 1, s * 2 + 2, (0xFF << (8 - h)) & 0xFF);
+			}
+		}
+	}
+	
+	//Lower edge of bucket 0, 6 and 12
+	oled_putstring(0, 7, "0", 0, 0);
+	oled_putstring(48, 7, "4m", 0, 0);
+	oled_putstring(96, 7, "262m", 0, 0);
+	
+	oled_flush();
+	while(get_keys());
+	while(!get_keys());
+}
+#endif
+
 int main(void)
 {
     int t1;
@@ -2072,8 +3443,6 @@ int main(void)
     long runseconds10x = 0;
     
     //Volts measurement
-    int adc_v;
-    double v1;	
     
     //Tone
     int toneset = 0;
@@ -2098,6 +3467,7 @@ int main(void)
 	//TWI init
 	_delay_ms(100);
 	twi_init();
+	sei(); //TWI is interrupt driven
 	_delay_ms(100);
 	
 	//si5351
@@ -2111,18 +3481,18 @@ int main(void)
 	//Interrupt definitions for rotary encoder PD5 and PD6
 	PCMSK2 |= ((1<<PCINT21) | (1<<PCINT22));  //enable encoder pins as interrupt source
 	PCICR |= (1<<PCIE2);                      // enable pin change interupts 
+	laststate = (PIND & 0x60) >> 5;           //Start decoder from current pin state
 	
 	//ADC config and ADC init
-    ADCSRA = (1<<ADPS0) | (1<<ADPS1) | (1<<ADEN); //Prescaler 64 and ADC on
-	get_adc(0); //One dummy conversion
+    adc_init();
 	
     //Timer 1 as counter for 10th seconds
     TCCR1A = 0;             // normal mode, no PWM
     TCCR1B = (1 << CS10) | (1 << CS12) | (1<<WGM12);   // Prescaler = 1/1024 based on system clock 16 MHz
                                                        // 15625 incs/sec
                                                        // and enable reset of counter register
-	OCR1AH = (1562 >> 8);                             //Load compare values to registers
-    OCR1AL = (1562 & 0x00FF);
+	OCR1AH = (TIMER1_TOP >> 8);                       //Load compare values to registers
+    OCR1AL = (TIMER1_TOP & 0x00FF);
 	TIMSK1 |= (1<<OCIE1A);
 
     //Load VFO data and VFO number
@@ -2195,21 +3565,7 @@ int main(void)
     for(;;)
     {
 		//TUNING		
-		if(tuningknob > 2 && !txrx)  
-		{    
-		    f_vfo[cur_vfo] += calc_tuningfactor();  
-		    set_vfo_frequency(f_vfo[cur_vfo] + INTERFREQUENCY);
-			tuningknob = 0;
-			show_frequency(f_vfo[cur_vfo], 0);
-		}
-		
-		if(tuningknob < -2 && !txrx)
-		{
-		    f_vfo[cur_vfo] -= calc_tuningfactor();  
-		    set_vfo_frequency(f_vfo[cur_vfo] + INTERFREQUENCY);
-			tuningknob = 0;
-			show_frequency(f_vfo[cur_vfo], 0);
-		}
+		tune_vfo(txrx);
 		
 		if(runseconds10 > runseconds10x)
 		{
@@ -2221,7 +3577,6 @@ int main(void)
 		{
 			rval = menux(f_vfo[cur_vfo], cur_vfo);
 			while(get_keys());
-			oled_cls(0);
 			switch(rval)
 			{
 				case 0: if(cur_vfo) //0 = Swap VFOs
@@ -2345,7 +3700,6 @@ int main(void)
             show_tone(toneset, 0);
             show_agc(agcset, 0);
             show_split(split);
-            draw_meter_scale(0);	
 		}	
 		
 		if(key == 2)
@@ -2355,6 +3709,22 @@ int main(void)
 			store_frequency(f_vfo[cur_vfo], cur_vfo, -1); //Store VFO
 			store_frequency(f_vfo[cur_vfo], cur_vfo, cur_mem); //Store current memory
 			//oled_putstring(60, 0, "OK", 0, 0);
+#if (LATENCYSTATS == 1)
+			lat_show();
+			while(get_keys());
+			key = 0;
+			oled_cls(0);
+			show_frequency(f_vfo[cur_vfo], 1);
+			show_vfo(cur_vfo, 0);
+			show_mem_num(cur_mem, 0);
+            show_sideband(sideband, 0);
+            show_temp(get_temp());
+            draw_meter_scale(txrx);
+            show_txrx(txrx);
+            show_tone(toneset, 0);
+            show_agc(agcset, 0);
+            show_split(split);
+#endif
 	    }
 	    
 	    if(!txrx)
@@ -2366,18 +3736,13 @@ int main(void)
             show_meter(get_tx_pwr_value());		
         }
         
-        //Delete max value of meter every 2 seconds
-        //Show volta0ge
+        //Show voltage and temperature every 2 seconds
 		if(runseconds10 > runseconds10s + 20)
 		{
-			//S-Value reset
-			reset_smax();
-			show_meter(get_s_value());			
+			runseconds10s = runseconds10;
 			
 			//Voltage
-			v1 = (double) get_adc(2) * 5 / 1024 * 5 * 10;
-		    adc_v = (int) v1;
-   		    show_voltage(adc_v);
+   		    show_voltage(adc2volt(get_adc_val(2, ADC_SMOOTH)));
    		    
    		    //PA Temp.
    		    show_temp(get_temp());
@@ -2388,6 +3753,7 @@ int main(void)
 			if(!txrx)
 			{
 				draw_meter_scale(1);
+				meter_peak_reset(1);
 				show_meter(0);
 			    txrx = 1;
 				show_txrx(txrx);
@@ -2413,6 +3779,7 @@ int main(void)
 			if(txrx) 
 			{
 				draw_meter_scale(0);
+				meter_peak_reset(0);
 				show_meter(0);
 			    txrx = 0;
 				show_txrx(txrx);
@@ -2432,6 +3799,11 @@ int main(void)
 				}	
 			}
 		}	
+		
+		oled_flush_budget(); //Send changes to display, frequency first
+#if (LATENCYSTATS == 1)
+		lat_check(f_vfo[cur_vfo]);
+#endif
     }
 	return 0;
 }